@@ -0,0 +1,465 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+#include "mesh_data.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Bounding volume hierarchy over axis aligned boxes (instance bounds in
+// world space), GL free. Answers the frustum and ray queries of a scene
+// without touching every instance.
+//
+// build:  top down, binned surface area heuristic (16 bins on each axis
+//         over the centroids). The two halves of a large node are built in
+//         parallel on the pool, large nodes are binned in parallel too.
+// refit:  new boxes for the same items, the tree keeps its shape. Cheap
+//         enough for every frame; rebuild once items moved far enough to
+//         make the old splits poor.
+// cull:   nodes fully inside the frustum accept their whole subtree
+//         without further plane tests.
+// ray:    nearest first traversal, for picking.
+
+namespace pwgl {
+
+// origin + t * direction; direction need not be normalized
+struct ray {
+    glm::vec3 origin { 0.0f };
+    glm::vec3 direction { 0.0f, 0.0f, -1.0f };
+};
+
+inline constexpr std::uint32_t no_item = ~std::uint32_t(0);
+
+struct bvh_hit {
+    std::uint32_t item { no_item };
+    float t { std::numeric_limits<float>::max() };
+
+    explicit operator bool() const {
+        return item != no_item;
+    }
+};
+
+struct bvh_node {
+    glm::vec3 min;
+    std::uint32_t first;    // leaf: first entry in bvh::items, interior: left child, the right one follows it
+    glm::vec3 max;
+    std::uint32_t count;    // items of a leaf, 0 for interior nodes
+};
+static_assert(sizeof(bvh_node) == 32);
+
+namespace detail {
+
+struct aabb {
+    glm::vec3 min { std::numeric_limits<float>::max() };
+    glm::vec3 max { -std::numeric_limits<float>::max() };
+
+    void grow(glm::vec3 p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+    void grow(aabb const & b) {
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+    float area() const {
+        glm::vec3 const e = max - min;
+        return e.x < 0.0f ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+};
+
+// entry distance of r into the box, or max_t when it misses or enters
+// beyond max_t
+inline float intersect(glm::vec3 min, glm::vec3 max, glm::vec3 origin, glm::vec3 inverse_direction, float max_t) {
+    glm::vec3 const t0 = (min - origin) * inverse_direction;
+    glm::vec3 const t1 = (max - origin) * inverse_direction;
+    glm::vec3 const first = glm::min(t0, t1);
+    glm::vec3 const last = glm::max(t0, t1);
+    float const enter = std::max({ first.x, first.y, first.z, 0.0f });
+    float const leave = std::min({ last.x, last.y, last.z, max_t });
+    return enter <= leave ? enter : max_t;
+}
+
+} // detail ns
+
+struct bvh {
+    static constexpr std::size_t bins = 16;
+    // leaves below min_leaf items are not worth a traversal step, above
+    // max_leaf they are split even when the heuristic would not
+    static constexpr std::size_t min_leaf = 4;
+    static constexpr std::size_t max_leaf = 8;
+    // below it object median splits, so the depth stays under 64 + 32
+    // and the query stacks never overflow
+    static constexpr std::size_t max_sah_depth = 64;
+
+    // builds the tree over bounds, items are the indices into it
+    void build(std::span<bounding_volume const> bounds) {
+        std::size_t const n = bounds.size();
+        nodes.clear();
+        items.resize(n);
+        boxes.resize(n);
+        centroids.resize(n);
+        if (!n)
+            return;
+
+        detail::aabb box;
+        detail::aabb centroid_box;
+        reduce(n, [&](std::size_t begin, std::size_t end, detail::aabb & b, detail::aabb & c) {
+            for (std::size_t i = begin; i < end; ++i) {
+                items[i] = static_cast<std::uint32_t>(i);
+                boxes[i] = { bounds[i].min, bounds[i].max };
+                centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+                b.grow(boxes[i]);
+                c.grow(centroids[i]);
+            }
+        }, box, centroid_box);
+
+        // a binary tree over n leaves has at most 2n - 1 nodes
+        nodes.resize(2 * n);
+        allocated.store(1, std::memory_order_relaxed);
+        split(0, 0, static_cast<std::uint32_t>(n), box, centroid_box, 0);
+        nodes.resize(allocated.load(std::memory_order_relaxed));
+    }
+
+    // new bounds for the items of the last build(), same count and order
+    void refit(std::span<bounding_volume const> bounds) {
+        if (bounds.size() != boxes.size() || nodes.empty())
+            return build(bounds);
+
+        workers().parallel_for(bounds.size(), 16384, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i)
+                boxes[i] = { bounds[i].min, bounds[i].max };
+        });
+        workers().parallel_for(nodes.size(), 16384, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                auto & node = nodes[i];
+                if (!node.count)
+                    continue;
+                detail::aabb b;
+                for (std::uint32_t k = node.first; k < node.first + node.count; ++k)
+                    b.grow(boxes[items[k]]);
+                node.min = b.min;
+                node.max = b.max;
+            }
+        });
+        // children always come after their parent
+        for (std::size_t i = nodes.size(); i-- > 0;) {
+            auto & node = nodes[i];
+            if (node.count)
+                continue;
+            auto const & l = nodes[node.first];
+            auto const & r = nodes[node.first + 1];
+            node.min = glm::min(l.min, r.min);
+            node.max = glm::max(l.max, r.max);
+        }
+    }
+
+    std::size_t size() const {
+        return boxes.size();
+    }
+
+    // appends the items whose boxes intersect the frustum to visible (in
+    // tree order), returns how many. the box test is the one of cull_boxes().
+    std::size_t cull(frustum const & f, std::vector<std::uint32_t> & visible) const {
+        std::size_t const before = visible.size();
+        if (nodes.empty())
+            return 0;
+        auto const planes = detail::cull_planes(f);
+
+        // node, planes it may still cross (bit per plane)
+        std::array<std::pair<std::uint32_t, std::uint32_t>, 128> stack;
+        std::size_t top = 0;
+        stack[top++] = { 0, 0x3f };
+        while (top) {
+            auto const [index, planes_left] = stack[--top];
+            auto const & node = nodes[index];
+            std::uint32_t mask = planes_left;
+            if (!test(planes, node.min, node.max, mask))
+                continue;
+            if (!mask) {
+                append_all(index, visible);
+                continue;
+            }
+            if (node.count) {
+                for (std::uint32_t k = node.first; k < node.first + node.count; ++k) {
+                    std::uint32_t item_mask = mask;
+                    if (test(planes, boxes[items[k]].min, boxes[items[k]].max, item_mask))
+                        visible.push_back(items[k]);
+                }
+                continue;
+            }
+            stack[top++] = { node.first + 1, mask };
+            stack[top++] = { node.first, mask };
+        }
+        return visible.size() - before;
+    }
+
+    // nearest item box hit by r within max_t
+    bvh_hit raycast(ray const & r, float max_t = std::numeric_limits<float>::max()) const {
+        return raycast(r, max_t, [](std::uint32_t, float t) { return t; });
+    }
+
+    // nearest hit by r within max_t, with a precise test per item:
+    // intersect(item, t) gets the entry distance into the item's box and
+    // returns the hit distance, or anything >= that of the best hit so far
+    // (max float) for a miss
+    template <typename F>
+    bvh_hit raycast(ray const & r, float max_t, F const & intersect) const {
+        bvh_hit hit;
+        hit.t = max_t;
+        if (nodes.empty())
+            return hit;
+
+        glm::vec3 const inverse(1.0f / r.direction.x, 1.0f / r.direction.y, 1.0f / r.direction.z);
+        std::array<std::pair<std::uint32_t, float>, 128> stack;
+        std::size_t top = 0;
+        float const root = detail::intersect(nodes[0].min, nodes[0].max, r.origin, inverse, hit.t);
+        if (root < hit.t)
+            stack[top++] = { 0, root };
+        while (top) {
+            auto const [index, enter] = stack[--top];
+            if (enter >= hit.t)
+                continue;
+            auto const & node = nodes[index];
+            if (node.count) {
+                for (std::uint32_t k = node.first; k < node.first + node.count; ++k) {
+                    std::uint32_t const item = items[k];
+                    float const t = detail::intersect(boxes[item].min, boxes[item].max, r.origin, inverse, hit.t);
+                    if (t >= hit.t)
+                        continue;
+                    float const precise = intersect(item, t);
+                    if (precise < hit.t) {
+                        hit.item = item;
+                        hit.t = precise;
+                    }
+                }
+                continue;
+            }
+            // the nearer child is popped first
+            std::uint32_t closer = node.first;
+            std::uint32_t farther = node.first + 1;
+            float t_closer = detail::intersect(nodes[closer].min, nodes[closer].max, r.origin, inverse, hit.t);
+            float t_farther = detail::intersect(nodes[farther].min, nodes[farther].max, r.origin, inverse, hit.t);
+            if (t_farther < t_closer) {
+                std::swap(closer, farther);
+                std::swap(t_closer, t_farther);
+            }
+            if (t_farther < hit.t)
+                stack[top++] = { farther, t_farther };
+            if (t_closer < hit.t)
+                stack[top++] = { closer, t_closer };
+        }
+        return hit;
+    }
+
+    std::vector<bvh_node> nodes;        // nodes[0] is the root
+    std::vector<std::uint32_t> items;   // leaf item lists
+
+private:
+    struct bin {
+        detail::aabb box;
+        std::uint32_t count { };
+    };
+    using bin_set = std::array<std::array<bin, bins>, 3>;
+
+    // f(begin, end, a, b) over [0, n) in parallel pieces, a and b merged
+    template <typename F>
+    static void reduce(std::size_t n, F const & f, detail::aabb & a, detail::aabb & b) {
+        constexpr std::size_t piece = 32768;
+        std::size_t const pieces = (n + piece - 1) / piece;
+        std::vector<std::pair<detail::aabb, detail::aabb>> partial(pieces);
+        workers().parallel_for(pieces, 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t p = begin; p < end; ++p)
+                f(p * piece, std::min(n, (p + 1) * piece), partial[p].first, partial[p].second);
+        });
+        for (auto const & [x, y] : partial) {
+            a.grow(x);
+            b.grow(y);
+        }
+    }
+
+    void bin_range(std::uint32_t begin, std::uint32_t end, detail::aabb const & centroid_box, bin_set & out) const {
+        glm::vec3 const extent = centroid_box.max - centroid_box.min;
+        glm::vec3 scale(0.0f);
+        for (int a = 0; a < 3; ++a)
+            scale[a] = extent[a] > 0.0f ? float(bins) * 0.9999f / extent[a] : 0.0f;
+        for (std::uint32_t k = begin; k < end; ++k) {
+            std::uint32_t const item = items[k];
+            glm::vec3 const c = centroids[item];
+            for (int a = 0; a < 3; ++a) {
+                auto & b = out[a][static_cast<std::size_t>((c[a] - centroid_box.min[a]) * scale[a])];
+                b.box.grow(boxes[item]);
+                ++b.count;
+            }
+        }
+    }
+
+    // makes nodes[index] the node of items [begin, end) with bounds box
+    void split(std::uint32_t index, std::uint32_t begin, std::uint32_t end, detail::aabb const & box, detail::aabb const & centroid_box,
+               std::size_t depth) {
+        auto & node = nodes[index];
+        node.min = box.min;
+        node.max = box.max;
+        std::uint32_t const n = end - begin;
+        auto make_leaf = [&] {
+            node.first = begin;
+            node.count = n;
+        };
+        if (n <= min_leaf)
+            return make_leaf();
+
+        // bins, in parallel pieces for the large nodes near the root
+        bin_set binned { };
+        constexpr std::uint32_t piece = 65536;
+        if (n > 2 * piece) {
+            std::uint32_t const pieces = (n + piece - 1) / piece;
+            std::vector<bin_set> partial(pieces);
+            workers().parallel_for(pieces, 1, [&](std::size_t first, std::size_t last) {
+                for (std::size_t p = first; p < last; ++p)
+                    bin_range(begin + static_cast<std::uint32_t>(p) * piece, std::min(end, begin + static_cast<std::uint32_t>(p + 1) * piece),
+                              centroid_box, partial[p]);
+            });
+            for (auto const & p : partial) {
+                for (std::size_t a = 0; a < 3; ++a) {
+                    for (std::size_t b = 0; b < bins; ++b) {
+                        binned[a][b].box.grow(p[a][b].box);
+                        binned[a][b].count += p[a][b].count;
+                    }
+                }
+            }
+        } else {
+            bin_range(begin, end, centroid_box, binned);
+        }
+
+        // sweep: cost of every split plane between two bins
+        float best_cost = std::numeric_limits<float>::max();
+        int best_axis = 0;
+        std::size_t best_split = 0;
+        for (int a = 0; a < 3; ++a) {
+            if (centroid_box.max[a] <= centroid_box.min[a])
+                continue;
+            std::array<float, bins> right_cost { };
+            detail::aabb right;
+            std::uint32_t right_count = 0;
+            for (std::size_t b = bins - 1; b > 0; --b) {
+                right.grow(binned[a][b].box);
+                right_count += binned[a][b].count;
+                right_cost[b] = right.area() * float(right_count);
+            }
+            detail::aabb left;
+            std::uint32_t left_count = 0;
+            for (std::size_t b = 0; b + 1 < bins; ++b) {
+                left.grow(binned[a][b].box);
+                left_count += binned[a][b].count;
+                float const cost = left.area() * float(left_count) + right_cost[b + 1];
+                if (left_count && left_count < n && cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_split = b + 1;
+                }
+            }
+        }
+
+        // one traversal step against testing every item
+        float const leaf_cost = box.area() * float(n);
+        bool const degenerate = best_cost == std::numeric_limits<float>::max();
+        if (n <= max_leaf && (degenerate || best_cost + box.area() >= leaf_cost))
+            return make_leaf();
+
+        detail::aabb boxes_of[2];
+        detail::aabb centroids_of[2];
+        std::uint32_t middle = begin + n / 2;
+        if (degenerate || depth >= max_sah_depth) {
+            // halves along the widest centroid axis, any halves for
+            // identical centroids
+            glm::vec3 const extent = centroid_box.max - centroid_box.min;
+            int const axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+            if (!degenerate) {
+                std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end, [&](std::uint32_t a, std::uint32_t b) {
+                    return centroids[a][axis] < centroids[b][axis];
+                });
+            }
+            for (std::uint32_t k = begin; k < end; ++k) {
+                boxes_of[k >= middle].grow(boxes[items[k]]);
+                centroids_of[k >= middle].grow(centroids[items[k]]);
+            }
+        } else {
+            for (std::size_t b = 0; b < bins; ++b)
+                boxes_of[b >= best_split].grow(binned[best_axis][b].box);
+            float const low = centroid_box.min[best_axis];
+            float const scale = float(bins) * 0.9999f / (centroid_box.max[best_axis] - low);
+            auto const it = std::partition(items.begin() + begin, items.begin() + end, [&](std::uint32_t item) {
+                return static_cast<std::size_t>((centroids[item][best_axis] - low) * scale) < best_split;
+            });
+            middle = static_cast<std::uint32_t>(it - items.begin());
+            for (std::uint32_t k = begin; k < end; ++k)
+                centroids_of[k >= middle].grow(centroids[items[k]]);
+        }
+
+        std::uint32_t const left = allocated.fetch_add(2, std::memory_order_relaxed);
+        node.first = left;
+        node.count = 0;
+        auto child = [&](std::size_t side) {
+            if (side == 0)
+                split(left, begin, middle, boxes_of[0], centroids_of[0], depth + 1);
+            else
+                split(left + 1, middle, end, boxes_of[1], centroids_of[1], depth + 1);
+        };
+        if (n > 8192) {
+            workers().parallel_for(2, 1, [&](std::size_t first, std::size_t last) {
+                for (std::size_t side = first; side < last; ++side)
+                    child(side);
+            });
+        } else {
+            child(0);
+            child(1);
+        }
+    }
+
+    // box against the planes in mask, clears the bits of planes the box is
+    // fully inside of. false if it is outside one of them.
+    static bool test(std::array<detail::cull_plane, 6> const & planes, glm::vec3 min, glm::vec3 max, std::uint32_t & mask) {
+        glm::vec3 const c = (min + max) * 0.5f;
+        glm::vec3 const e = (max - min) * 0.5f;
+        for (std::size_t i = 0; i < 6; ++i) {
+            if (!(mask & (1u << i)))
+                continue;
+            auto const & p = planes[i];
+            float const d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+            float const r = p.ax * e.x + p.ay * e.y + p.az * e.z;
+            if (d + r < 0.0f)
+                return false;
+            if (d - r >= 0.0f)
+                mask &= ~(1u << i);
+        }
+        return true;
+    }
+
+    void append_all(std::uint32_t index, std::vector<std::uint32_t> & out) const {
+        auto const & node = nodes[index];
+        if (node.count) {
+            out.insert(out.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+            return;
+        }
+        append_all(node.first, out);
+        append_all(node.first + 1, out);
+    }
+
+    std::vector<detail::aabb> boxes;        // per item, as of the last build() / refit()
+    std::vector<glm::vec3> centroids;       // per item, build() scratch
+    std::atomic<std::uint32_t> allocated { };
+};
+
+} // pwgl ns
+#endif
@@ -10,6 +10,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "bvh.hpp"
+
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
 enum Camera_Movement
 {
@@ -68,6 +70,20 @@ public:
                            this->up);
     }
 
+    // Returns the ray through the window position (x, y), in pixels from the top left, starting on the near plane of projection.
+    // Its direction reaches the far plane, for picking with pwgl::bvh::raycast.
+    pwgl::ray get_ray(float x, float y, float width, float height, glm::mat4 const & projection) {
+        glm::mat4 const inverse = glm::inverse(projection * this->get_view_matrix());
+        float const ndc_x = 2.0f * x / width - 1.0f;
+        float const ndc_y = 1.0f - 2.0f * y / height;
+        glm::vec4 const on_near = inverse * glm::vec4(ndc_x, ndc_y, -1.0f, 1.0f);
+        glm::vec4 const on_far = inverse * glm::vec4(ndc_x, ndc_y, 1.0f, 1.0f);
+        pwgl::ray r;
+        r.origin = glm::vec3(on_near) / on_near.w;
+        r.direction = glm::vec3(on_far) / on_far.w - r.origin;
+        return r;
+    }
+
     // Processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, double deltaTime) {
         GLfloat velocity = static_cast<GLfloat>(this->movementSpeed * deltaTime);
@@ -133,6 +149,10 @@ public:
         return this->zoom;
     }
 
+    glm::vec3 get_position() {
+        return this->position;
+    }
+
 private:
     // Calculates the front vector from the Camera's (updated) Eular Angles
     void updateCameraVectors()
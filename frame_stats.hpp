@@ -0,0 +1,31 @@
+#ifndef FRAME_STATS_HPP
+#define FRAME_STATS_HPP
+
+#include <cstddef>
+
+namespace pwgl {
+
+// counters of the frame being rendered, shown in the fps overlay
+struct frame_stats {
+    std::size_t draw_calls { };     // glDraw* / glMultiDraw* calls issued
+    std::size_t draw_commands { };  // individual mesh draws they contain
+    std::size_t state_changes { };          // program, vao and texture binds issued
+    std::size_t state_changes_avoided { };  // ... and skipped as redundant
+    std::size_t clusters_culled { };        // meshlets rejected by model::draw_clusters
+    std::size_t instances_culled { };       // scene instances rejected by the bvh
+    std::size_t instances_occluded { };     // ... and by the hi-z test
+    double fence_wait_ms { };               // cpu blocked on ring_buffer fences
+    double upload_ms { };                   // model_loader uploads
+
+    void reset() {
+        *this = { };
+    }
+};
+
+inline frame_stats & stats() {
+    static frame_stats s;
+    return s;
+}
+
+} // pwgl ns
+#endif
@@ -0,0 +1,58 @@
+#ifndef FRAME_UNIFORMS_HPP
+#define FRAME_UNIFORMS_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.hpp"
+#include "ring_buffer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+// Per frame camera data, shared by every program through the uniform
+// block "frame" at a fixed binding point (shader::introspect binds the
+// block of each program). Written once per frame into the streaming ring
+// buffer, so per program uniform traffic is per object data only.
+//
+// GLSL side (std140), kept in sync by hand in resources/shaders/*.glsl:
+//
+//   layout (std140) uniform frame {
+//       mat4 view;
+//       mat4 projection;
+//       mat4 view_projection;
+//       vec3 camera_position;
+//       float time;
+//       vec4 viewport;     // width, height, 1 / width, 1 / height
+//   };
+
+namespace pwgl {
+
+struct frame_uniforms {
+    glm::mat4 view { 1.0f };
+    glm::mat4 projection { 1.0f };
+    glm::mat4 view_projection { 1.0f };
+    glm::vec3 camera_position { 0.0f };
+    float time { };
+    glm::vec4 viewport { 0.0f };
+
+    static constexpr char const * block = "frame";
+    static constexpr unsigned binding = 0;
+};
+static_assert(sizeof(frame_uniforms) == 3 * 64 + 16 + 16, "must match the std140 layout");
+
+// writes frame into this frame's region of stream and binds it to the
+// binding point of the block
+inline void bind_frame_uniforms(ring_buffer & stream, frame_uniforms const & frame) {
+    static std::size_t const alignment = [] {
+        int a = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &a);
+        return static_cast<std::size_t>(std::max(a, 16));
+    }();
+    auto const a = stream.write(&frame, sizeof(frame), alignment);
+    stream.flush();
+    gl().bind_buffer_range(GL_UNIFORM_BUFFER, frame_uniforms::binding, stream.buffer, a.offset, sizeof(frame));
+}
+
+} // pwgl ns
+#endif
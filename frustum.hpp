@@ -0,0 +1,256 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// View frustum culling of bounding volumes, GL free. The volumes are kept
+// in structure of arrays form so the tests run on 8 (AVX) or 4 (SSE, NEON)
+// volumes at once.
+
+namespace pwgl {
+
+struct frustum {
+    // plane: dot(xyz, p) + w >= 0 on the inside, xyz normalized
+    std::array<glm::vec4, 6> planes;
+
+    // planes of a clip transform (Gribb/Hartmann). built from
+    // projection * view * model the planes are in model space, so mesh
+    // bounds can be tested without transforming them.
+    static frustum from(glm::mat4 const & m) {
+        auto row = [&m](int i) {
+            return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        };
+        frustum f;
+        f.planes[0] = row(3) + row(0);  // left
+        f.planes[1] = row(3) - row(0);  // right
+        f.planes[2] = row(3) + row(1);  // bottom
+        f.planes[3] = row(3) - row(1);  // top
+        f.planes[4] = row(3) + row(2);  // near
+        f.planes[5] = row(3) - row(2);  // far
+        for (auto & p : f.planes) {
+            float const l = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+            if (l > 0.0f)
+                p = p / l;
+        }
+        return f;
+    }
+};
+
+// bounding volumes in structure of arrays form, padded to a multiple of 8
+struct bounds_soa {
+    void push_back(bounding_volume const & bv) {
+        std::size_t const i = count++;
+        resize((count + 7) & ~std::size_t(7));
+        set(i, bv);
+    }
+
+    // replaces volume i, i < size()
+    void set(std::size_t i, bounding_volume const & bv) {
+        glm::vec3 const c = (bv.min + bv.max) * 0.5f;
+        glm::vec3 const e = (bv.max - bv.min) * 0.5f;
+        cx[i] = c.x;
+        cy[i] = c.y;
+        cz[i] = c.z;
+        ex[i] = e.x;
+        ey[i] = e.y;
+        ez[i] = e.z;
+        sx[i] = bv.center.x;
+        sy[i] = bv.center.y;
+        sz[i] = bv.center.z;
+        sr[i] = bv.radius;
+    }
+
+    void clear() {
+        count = 0;
+        resize(0);
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    // box center / half extent
+    std::vector<float> cx, cy, cz, ex, ey, ez;
+    // sphere center / radius
+    std::vector<float> sx, sy, sz, sr;
+
+private:
+    void resize(std::size_t n) {
+        for (auto * v : { &cx, &cy, &cz, &ex, &ey, &ez, &sx, &sy, &sz, &sr })
+            v->resize(n, 0.0f);
+    }
+
+    std::size_t count { };
+};
+
+namespace detail {
+
+// one plane broadcast for the simd loops, plus |normal| for the box extent
+struct cull_plane {
+    float x, y, z, w, ax, ay, az;
+};
+
+inline std::array<cull_plane, 6> cull_planes(frustum const & f) {
+    std::array<cull_plane, 6> out;
+    for (std::size_t i = 0; i < 6; ++i) {
+        auto const & p = f.planes[i];
+        out[i] = { p.x, p.y, p.z, p.w, std::fabs(p.x), std::fabs(p.y), std::fabs(p.z) };
+    }
+    return out;
+}
+
+} // detail ns
+
+// visible[i] = 1 if box i intersects the frustum. boxes are tested
+// conservatively: a box is culled only if it is fully outside one plane.
+inline void cull_boxes(frustum const & f, bounds_soa const & b, std::vector<std::uint8_t> & visible) {
+    auto const planes = detail::cull_planes(f);
+    visible.resize(b.size());
+    std::size_t i = 0;
+
+#if defined(__AVX__)
+    for (; i + 8 <= b.cx.size() && i < b.size(); i += 8) {
+        __m256 const cx = _mm256_loadu_ps(&b.cx[i]), cy = _mm256_loadu_ps(&b.cy[i]), cz = _mm256_loadu_ps(&b.cz[i]);
+        __m256 const ex = _mm256_loadu_ps(&b.ex[i]), ey = _mm256_loadu_ps(&b.ey[i]), ez = _mm256_loadu_ps(&b.ez[i]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (auto const & p : planes) {
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.x), cx), _mm256_set1_ps(p.w));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.y), cy));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.z), cz));
+            __m256 r = _mm256_mul_ps(_mm256_set1_ps(p.ax), ex);
+            r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(p.ay), ey));
+            r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_set1_ps(p.az), ez));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        int const mask = _mm256_movemask_ps(inside);
+        for (std::size_t k = 0; k < 8 && i + k < b.size(); ++k)
+            visible[i + k] = static_cast<std::uint8_t>((mask >> k) & 1);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    for (; i + 4 <= b.cx.size() && i < b.size(); i += 4) {
+        __m128 const cx = _mm_loadu_ps(&b.cx[i]), cy = _mm_loadu_ps(&b.cy[i]), cz = _mm_loadu_ps(&b.cz[i]);
+        __m128 const ex = _mm_loadu_ps(&b.ex[i]), ey = _mm_loadu_ps(&b.ey[i]), ez = _mm_loadu_ps(&b.ez[i]);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (auto const & p : planes) {
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), cx), _mm_set1_ps(p.w));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.y), cy));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.z), cz));
+            __m128 r = _mm_mul_ps(_mm_set1_ps(p.ax), ex);
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(p.ay), ey));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(p.az), ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+        int const mask = _mm_movemask_ps(inside);
+        for (std::size_t k = 0; k < 4 && i + k < b.size(); ++k)
+            visible[i + k] = static_cast<std::uint8_t>((mask >> k) & 1);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= b.cx.size() && i < b.size(); i += 4) {
+        float32x4_t const cx = vld1q_f32(&b.cx[i]), cy = vld1q_f32(&b.cy[i]), cz = vld1q_f32(&b.cz[i]);
+        float32x4_t const ex = vld1q_f32(&b.ex[i]), ey = vld1q_f32(&b.ey[i]), ez = vld1q_f32(&b.ez[i]);
+        uint32x4_t inside = vdupq_n_u32(~0u);
+        for (auto const & p : planes) {
+            float32x4_t d = vmlaq_n_f32(vdupq_n_f32(p.w), cx, p.x);
+            d = vmlaq_n_f32(d, cy, p.y);
+            d = vmlaq_n_f32(d, cz, p.z);
+            float32x4_t r = vmulq_n_f32(ex, p.ax);
+            r = vmlaq_n_f32(r, ey, p.ay);
+            r = vmlaq_n_f32(r, ez, p.az);
+            inside = vandq_u32(inside, vcgeq_f32(vaddq_f32(d, r), vdupq_n_f32(0.0f)));
+        }
+        std::uint32_t lanes[4];
+        vst1q_u32(lanes, inside);
+        for (std::size_t k = 0; k < 4 && i + k < b.size(); ++k)
+            visible[i + k] = static_cast<std::uint8_t>(lanes[k] & 1);
+    }
+#endif
+
+    for (; i < b.size(); ++i) {
+        bool inside = true;
+        for (auto const & p : planes) {
+            float const d = p.x * b.cx[i] + p.y * b.cy[i] + p.z * b.cz[i] + p.w;
+            float const r = p.ax * b.ex[i] + p.ay * b.ey[i] + p.az * b.ez[i];
+            inside = inside && d + r >= 0.0f;
+        }
+        visible[i] = inside;
+    }
+}
+
+// visible[i] = 1 if sphere i intersects the frustum
+inline void cull_spheres(frustum const & f, bounds_soa const & b, std::vector<std::uint8_t> & visible) {
+    auto const planes = detail::cull_planes(f);
+    visible.resize(b.size());
+    std::size_t i = 0;
+
+#if defined(__AVX__)
+    for (; i + 8 <= b.sx.size() && i < b.size(); i += 8) {
+        __m256 const sx = _mm256_loadu_ps(&b.sx[i]), sy = _mm256_loadu_ps(&b.sy[i]), sz = _mm256_loadu_ps(&b.sz[i]);
+        __m256 const nr = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&b.sr[i]));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (auto const & p : planes) {
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p.x), sx), _mm256_set1_ps(p.w));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.y), sy));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.z), sz));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, nr, _CMP_GE_OQ));
+        }
+        int const mask = _mm256_movemask_ps(inside);
+        for (std::size_t k = 0; k < 8 && i + k < b.size(); ++k)
+            visible[i + k] = static_cast<std::uint8_t>((mask >> k) & 1);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    for (; i + 4 <= b.sx.size() && i < b.size(); i += 4) {
+        __m128 const sx = _mm_loadu_ps(&b.sx[i]), sy = _mm_loadu_ps(&b.sy[i]), sz = _mm_loadu_ps(&b.sz[i]);
+        __m128 const nr = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&b.sr[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (auto const & p : planes) {
+            __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), sx), _mm_set1_ps(p.w));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.y), sy));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.z), sz));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, nr));
+        }
+        int const mask = _mm_movemask_ps(inside);
+        for (std::size_t k = 0; k < 4 && i + k < b.size(); ++k)
+            visible[i + k] = static_cast<std::uint8_t>((mask >> k) & 1);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= b.sx.size() && i < b.size(); i += 4) {
+        float32x4_t const sx = vld1q_f32(&b.sx[i]), sy = vld1q_f32(&b.sy[i]), sz = vld1q_f32(&b.sz[i]);
+        float32x4_t const nr = vnegq_f32(vld1q_f32(&b.sr[i]));
+        uint32x4_t inside = vdupq_n_u32(~0u);
+        for (auto const & p : planes) {
+            float32x4_t d = vmlaq_n_f32(vdupq_n_f32(p.w), sx, p.x);
+            d = vmlaq_n_f32(d, sy, p.y);
+            d = vmlaq_n_f32(d, sz, p.z);
+            inside = vandq_u32(inside, vcgeq_f32(d, nr));
+        }
+        std::uint32_t lanes[4];
+        vst1q_u32(lanes, inside);
+        for (std::size_t k = 0; k < 4 && i + k < b.size(); ++k)
+            visible[i + k] = static_cast<std::uint8_t>(lanes[k] & 1);
+    }
+#endif
+
+    for (; i < b.size(); ++i) {
+        bool inside = true;
+        for (auto const & p : planes)
+            inside = inside && p.x * b.sx[i] + p.y * b.sy[i] + p.z * b.sz[i] + p.w >= -b.sr[i];
+        visible[i] = inside;
+    }
+}
+
+} // pwgl ns
+#endif
@@ -0,0 +1,297 @@
+#ifndef GL_STATE_HPP
+#define GL_STATE_HPP
+
+#include <GL/glew.h>
+
+#include "frame_stats.hpp"
+
+#include "fmt/format.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// Shadow of the GL binding state of the rendering context: program, VAO,
+// active unit, 2D texture per unit, buffer bindings and depth/cull state.
+// Calls that would not change anything are skipped and counted in
+// frame_stats. Everything drawing through pwgl must bind through gl(),
+// a raw glBind* call desynchronizes the shadow (call invalidate() after
+// foreign code). Only the thread owning the main context may use it.
+//
+// Build with PWGL_VALIDATE_GL_STATE to check the shadow against glGet*
+// on every skipped call and in validate().
+
+namespace pwgl {
+
+struct gl_state {
+#ifdef PWGL_VALIDATE_GL_STATE
+    static constexpr bool validating = true;
+#else
+    static constexpr bool validating = false;
+#endif
+
+    // never a valid GL name or enum
+    static constexpr unsigned unknown = ~0u;
+    static constexpr std::size_t texture_units = 16;
+
+    bool use_program(unsigned id) {
+        if (program == id)
+            return skipped(GL_CURRENT_PROGRAM, program, "program");
+        glUseProgram(id);
+        program = id;
+        return changed();
+    }
+
+    // the element array binding is part of the VAO, so it is unknown after
+    // a VAO change
+    bool bind_vertex_array(unsigned id) {
+        if (vao == id)
+            return skipped(GL_VERTEX_ARRAY_BINDING, vao, "vertex array");
+        glBindVertexArray(id);
+        vao = id;
+        buffers[element_array_slot] = unknown;
+        return changed();
+    }
+
+    bool active_texture(unsigned unit) {
+        if (active == unit)
+            return skipped(GL_ACTIVE_TEXTURE, GL_TEXTURE0 + active, "active texture");
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active = unit;
+        return changed();
+    }
+
+    // GL_TEXTURE_2D on unit, leaves unit active when it has to bind
+    bool bind_texture(unsigned unit, unsigned id) {
+        if (unit < texture_units && textures[unit] == id) {
+            if constexpr (validating)
+                expect_texture(unit);
+            return avoided();
+        }
+        active_texture(unit);
+        glBindTexture(GL_TEXTURE_2D, id);
+        if (unit < texture_units)
+            textures[unit] = id;
+        return changed();
+    }
+
+    bool bind_buffer(GLenum target, unsigned id) {
+        std::size_t const slot = buffer_slot(target);
+        if (slot < buffers.size() && buffers[slot] == id)
+            return skipped(buffer_bindings[slot], id, "buffer");
+        glBindBuffer(target, id);
+        if (slot < buffers.size())
+            buffers[slot] = id;
+        return changed();
+    }
+
+    // indexed binding, also replaces the generic binding of target
+    void bind_buffer_base(GLenum target, unsigned index, unsigned id) {
+        glBindBufferBase(target, index, id);
+        std::size_t const slot = buffer_slot(target);
+        if (slot < buffers.size())
+            buffers[slot] = id;
+        changed();
+    }
+
+    void bind_buffer_range(GLenum target, unsigned index, unsigned id, std::size_t offset, std::size_t size) {
+        glBindBufferRange(target, index, id, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+        std::size_t const slot = buffer_slot(target);
+        if (slot < buffers.size())
+            buffers[slot] = id;
+        changed();
+    }
+
+    // GL_DEPTH_TEST, GL_CULL_FACE or GL_BLEND
+    bool enable(GLenum cap, bool on = true) {
+        std::size_t const slot = capability_slot(cap);
+        if (slot < capabilities.size() && capabilities[slot] == unsigned(on))
+            return skipped_capability(cap, on);
+        if (on)
+            glEnable(cap);
+        else
+            glDisable(cap);
+        if (slot < capabilities.size())
+            capabilities[slot] = on;
+        return changed();
+    }
+
+    bool disable(GLenum cap) {
+        return enable(cap, false);
+    }
+
+    bool depth_func(GLenum func) {
+        if (depth == func)
+            return skipped(GL_DEPTH_FUNC, depth, "depth func");
+        glDepthFunc(func);
+        depth = func;
+        return changed();
+    }
+
+    bool cull_face(GLenum mode) {
+        if (cull == mode)
+            return skipped(GL_CULL_FACE_MODE, cull, "cull face");
+        glCullFace(mode);
+        cull = mode;
+        return changed();
+    }
+
+    // deleting a bound object unbinds it in the current context
+    void delete_texture(unsigned id) {
+        glDeleteTextures(1, &id);
+        for (auto & t : textures) {
+            if (t == id)
+                t = 0;
+        }
+    }
+
+    void delete_buffer(unsigned id) {
+        glDeleteBuffers(1, &id);
+        for (auto & b : buffers) {
+            if (b == id)
+                b = 0;
+        }
+    }
+
+    void delete_vertex_array(unsigned id) {
+        glDeleteVertexArrays(1, &id);
+        if (vao == id) {
+            vao = 0;
+            buffers[element_array_slot] = unknown;
+        }
+    }
+
+    // forget everything, the next call of each kind goes to GL
+    void invalidate() {
+        *this = { };
+    }
+
+    // compares every known value against glGet*, reports the mismatches
+    bool validate() const {
+        bool ok = true;
+        ok &= matches(GL_CURRENT_PROGRAM, program, "program");
+        ok &= matches(GL_VERTEX_ARRAY_BINDING, vao, "vertex array");
+        for (std::size_t i = 0; i < buffers.size(); ++i)
+            ok &= matches(buffer_bindings[i], buffers[i], "buffer");
+        ok &= matches(GL_DEPTH_FUNC, depth, "depth func");
+        ok &= matches(GL_CULL_FACE_MODE, cull, "cull face");
+        for (std::size_t i = 0; i < capabilities.size(); ++i) {
+            if (capabilities[i] != unknown && bool(glIsEnabled(capability_enums[i])) != bool(capabilities[i])) {
+                fmt::print("[-] gl_state: capability {:#x}: shadow {}\n", capability_enums[i], capabilities[i]);
+                ok = false;
+            }
+        }
+        ok &= matches(GL_ACTIVE_TEXTURE, active == unknown ? unknown : GL_TEXTURE0 + active, "active texture");
+        for (unsigned unit = 0; unit < texture_units; ++unit) {
+            if (textures[unit] == unknown)
+                continue;
+            glActiveTexture(GL_TEXTURE0 + unit);
+            ok &= matches(GL_TEXTURE_BINDING_2D, textures[unit], "texture");
+        }
+        if (active != unknown)
+            glActiveTexture(GL_TEXTURE0 + active);
+        return ok;
+    }
+
+private:
+    static constexpr std::size_t element_array_slot = 1;
+    static constexpr std::array<GLenum, 5> buffer_targets {
+        GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_DRAW_INDIRECT_BUFFER, GL_PIXEL_UNPACK_BUFFER
+    };
+    static constexpr std::array<GLenum, 5> buffer_bindings {
+        GL_ARRAY_BUFFER_BINDING, GL_ELEMENT_ARRAY_BUFFER_BINDING, GL_UNIFORM_BUFFER_BINDING,
+        GL_DRAW_INDIRECT_BUFFER_BINDING, GL_PIXEL_UNPACK_BUFFER_BINDING
+    };
+    static constexpr std::array<GLenum, 3> capability_enums { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND };
+
+    // index into buffers / capabilities, size() for untracked enums
+    static std::size_t buffer_slot(GLenum target) {
+        std::size_t i = 0;
+        while (i < buffer_targets.size() && buffer_targets[i] != target)
+            ++i;
+        return i;
+    }
+
+    static std::size_t capability_slot(GLenum cap) {
+        std::size_t i = 0;
+        while (i < capability_enums.size() && capability_enums[i] != cap)
+            ++i;
+        return i;
+    }
+
+    static bool matches(GLenum pname, unsigned shadow, char const * what) {
+        if (shadow == unknown)
+            return true;
+        int actual = 0;
+        glGetIntegerv(pname, &actual);
+        if (static_cast<unsigned>(actual) == shadow)
+            return true;
+        fmt::print("[-] gl_state: {}: shadow {}, GL {}\n", what, shadow, actual);
+        return false;
+    }
+
+    static void expect(GLenum pname, unsigned shadow, char const * what) {
+        if (!matches(pname, shadow, what))
+            throw std::logic_error("GL state shadow out of sync");
+    }
+
+    void expect_texture(unsigned unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        bool const ok = matches(GL_TEXTURE_BINDING_2D, textures[unit], "texture");
+        if (active != unknown)
+            glActiveTexture(GL_TEXTURE0 + active);
+        if (!ok)
+            throw std::logic_error("GL state shadow out of sync");
+    }
+
+    static bool skipped(GLenum pname, unsigned shadow, char const * what) {
+        if constexpr (validating)
+            expect(pname, shadow, what);
+        return avoided();
+    }
+
+    static bool skipped_capability(GLenum cap, bool on) {
+        if constexpr (validating) {
+            if (bool(glIsEnabled(cap)) != on) {
+                fmt::print("[-] gl_state: capability {:#x}: shadow {}\n", cap, on);
+                throw std::logic_error("GL state shadow out of sync");
+            }
+        }
+        return avoided();
+    }
+
+    static bool avoided() {
+        ++stats().state_changes_avoided;
+        return false;
+    }
+
+    static bool changed() {
+        ++stats().state_changes;
+        return true;
+    }
+
+    static constexpr std::array<unsigned, texture_units> unknown_textures() {
+        std::array<unsigned, texture_units> a { };
+        for (auto & t : a)
+            t = unknown;
+        return a;
+    }
+
+    unsigned program { unknown };
+    unsigned vao { unknown };
+    unsigned active { unknown };
+    std::array<unsigned, texture_units> textures = unknown_textures();
+    std::array<unsigned, buffer_targets.size()> buffers { unknown, unknown, unknown, unknown, unknown };
+    std::array<unsigned, capability_enums.size()> capabilities { unknown, unknown, unknown };
+    unsigned depth { unknown };
+    unsigned cull { unknown };
+};
+
+inline gl_state & gl() {
+    static gl_state state;
+    return state;
+}
+
+} // pwgl ns
+#endif
@@ -0,0 +1,234 @@
+#ifndef HIZ_HPP
+#define HIZ_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "frame_stats.hpp"
+#include "gl_state.hpp"
+#include "mesh_data.hpp"
+#include "ring_buffer.hpp"
+#include "shader.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Hierarchical-Z occlusion culling on the GPU, within GL 3.3: the
+// occluders are drawn into the base level of a depth texture, the mip
+// levels are reduced to the farthest depth below them by drawing each level
+// into the next (gl_FragDepth, depth func GL_ALWAYS), and the boxes are
+// tested by a vertex shader, one point per box, whose verdicts are
+// captured with transform feedback. The pyramid and the test are those of
+// occlusion.hpp, which is the CPU fallback and the headless reference.
+//
+// Nothing waits on the GPU: the verdicts are read back by the next test(),
+// a frame later. An instance coming out from behind an occluder appears one
+// frame late.
+//
+// Usage per frame: begin_occluders(), draw the occluders, end_occluders(),
+// test(); visible holds the verdicts of the previous test().
+//
+// Programs: resources/shaders/hiz_downsample.glsl, and
+// resources/shaders/hiz_cull.glsl linked with feedback_varyings.
+
+namespace pwgl {
+
+struct hiz_culler {
+    static constexpr std::array<char const *, 1> feedback_varyings { "visible" };
+
+    // the pyramid's base level is width x height, the boxes of test() go
+    // through stream
+    hiz_culler(ring_buffer & boxes, shader const & downsample_program, shader const & cull_program, std::uint32_t w, std::uint32_t h)
+        : stream(boxes)
+        , downsample(downsample_program)
+        , cull(cull_program)
+        , width(w)
+        , height(h)
+    {
+        for (std::uint32_t n = std::max(width, height); n > 1; n /= 2)
+            ++levels;
+
+        glGenTextures(1, &depth);
+        pwgl::gl().bind_texture(0, depth);
+        pwgl::gl().active_texture(0);
+        for (int l = 0; l < levels; ++l) {
+            glTexImage2D(GL_TEXTURE_2D, l, GL_DEPTH_COMPONENT32F, level_width(l), level_height(l), 0, GL_DEPTH_COMPONENT,
+                         GL_FLOAT, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            fmt::print("[-] hiz_culler: incomplete framebuffer\n");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // the full screen triangle comes from gl_VertexID, the core profile
+        // still needs a vertex array bound
+        glGenVertexArrays(1, &empty_vao);
+        glGenVertexArrays(1, &boxes_vao);
+        glGenBuffers(1, &verdicts);
+
+        previous_size_u = downsample.uniform("previous_size");
+        view_projection_u = cull.uniform("view_projection");
+        levels_u = cull.uniform("levels");
+        fmt::print("[~] hiz_culler: {}x{}, {} levels\n", width, height, levels);
+    }
+    hiz_culler(hiz_culler const &) = delete;
+    hiz_culler & operator=(hiz_culler const &) = delete;
+    ~hiz_culler() {
+        if (fence)
+            glDeleteSync(fence);
+        glDeleteFramebuffers(1, &framebuffer);
+        pwgl::gl().delete_texture(depth);
+        pwgl::gl().delete_vertex_array(empty_vao);
+        pwgl::gl().delete_vertex_array(boxes_vao);
+        pwgl::gl().delete_buffer(verdicts);
+    }
+
+    // the following draws go to the pyramid's base level, depth only
+    void begin_occluders() {
+        glGetIntegerv(GL_VIEWPORT, viewport.data());
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        glViewport(0, 0, level_width(0), level_height(0));
+        glClear(GL_DEPTH_BUFFER_BIT);
+        pwgl::gl().enable(GL_DEPTH_TEST);
+        pwgl::gl().depth_func(GL_LESS);
+    }
+
+    // reduces the levels, restores the default framebuffer and viewport
+    void end_occluders() {
+        downsample.use();
+        pwgl::gl().bind_vertex_array(empty_vao);
+        // the level parameters go to the unit's binding, which may have
+        // been skipped as redundant
+        auto const unit = static_cast<unsigned>(downsample.texture_unit("depth"));
+        pwgl::gl().bind_texture(unit, depth);
+        pwgl::gl().active_texture(unit);
+        pwgl::gl().depth_func(GL_ALWAYS);
+        for (int l = 1; l < levels; ++l) {
+            // read level l - 1 only, it is not the one being written
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, l - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, l - 1);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, l);
+            glViewport(0, 0, level_width(l), level_height(l));
+            glUniform2i(previous_size_u.location, level_width(l - 1), level_height(l - 1));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        pwgl::gl().depth_func(GL_LESS);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // collects the verdicts of the previous test() into visible, then
+    // queues the test of boxes (world space) against the pyramid
+    void test(std::span<bounding_volume const> boxes, glm::mat4 const & view_projection) {
+        read_back();
+        if (boxes.empty())
+            return;
+
+        auto const a = stream.write(boxes.data(), boxes.size_bytes());
+        stream.flush();
+        pwgl::gl().bind_vertex_array(boxes_vao);
+        pwgl::gl().bind_buffer(GL_ARRAY_BUFFER, stream.buffer);
+        auto const stride = static_cast<GLsizei>(sizeof(bounding_volume));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void const *>(a.offset + offsetof(bounding_volume, min)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void const *>(a.offset + offsetof(bounding_volume, max)));
+
+        // orphaned, the previous verdicts are read already
+        auto const bytes = static_cast<GLsizeiptr>(boxes.size() * sizeof(std::uint32_t));
+        pwgl::gl().bind_buffer_base(GL_TRANSFORM_FEEDBACK_BUFFER, 0, verdicts);
+        glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+
+        cull.use();
+        cull.set(view_projection_u, view_projection);
+        cull.set(levels_u, levels);
+        pwgl::gl().bind_texture(static_cast<unsigned>(cull.texture_unit("hiz")), depth);
+        pwgl::gl().enable(GL_RASTERIZER_DISCARD);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(boxes.size()));
+        glEndTransformFeedback();
+        pwgl::gl().disable(GL_RASTERIZER_DISCARD);
+
+        pending = boxes.size();
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // per box of the test() before the last one: 1 visible, 0 occluded
+    std::vector<std::uint8_t> visible;
+
+private:
+    GLsizei level_width(int l) const {
+        return static_cast<GLsizei>(std::max(1u, width >> l));
+    }
+    GLsizei level_height(int l) const {
+        return static_cast<GLsizei>(std::max(1u, height >> l));
+    }
+
+    void read_back() {
+        if (!fence)
+            return;
+        auto const start = std::chrono::steady_clock::now();
+        GLbitfield flags = 0;
+        for (;;) {
+            GLenum const result = glClientWaitSync(fence, flags, 1'000'000);   // 1 ms
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+                break;
+            flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        }
+        stats().fence_wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glDeleteSync(fence);
+        fence = nullptr;
+
+        results.resize(pending);
+        pwgl::gl().bind_buffer_base(GL_TRANSFORM_FEEDBACK_BUFFER, 0, verdicts);
+        glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, static_cast<GLsizeiptr>(pending * sizeof(std::uint32_t)), results.data());
+        visible.resize(pending);
+        for (std::size_t i = 0; i < pending; ++i)
+            visible[i] = static_cast<std::uint8_t>(results[i] != 0);
+    }
+
+    ring_buffer & stream;
+    shader const & downsample;
+    shader const & cull;
+    std::uint32_t width;
+    std::uint32_t height;
+    int levels { 1 };
+    std::array<GLint, 4> viewport { };
+
+    unsigned depth { };
+    unsigned framebuffer { };
+    unsigned empty_vao { };
+    unsigned boxes_vao { };
+    unsigned verdicts { };                  // transform feedback output, a uint per box
+    GLsync fence { };                       // after the last test()
+    std::size_t pending { };                // boxes of the last test()
+    std::vector<std::uint32_t> results;
+
+    uniform_handle previous_size_u;
+    uniform_handle view_projection_u;
+    uniform_handle levels_u;
+};
+
+} // pwgl ns
+#endif
@@ -0,0 +1,81 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <GL/glew.h>
+#include <stb_image.h>
+
+#include "gl_state.hpp"
+
+#include "fmt/format.h"
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace pwgl {
+
+// decoded pixels, produced on worker threads and consumed by the GL thread
+struct decoded_image {
+    std::string filename;
+    int width { };
+    int height { };
+    int components { };
+    std::unique_ptr<unsigned char, decltype(&stbi_image_free)> data { nullptr, stbi_image_free };
+};
+
+inline decoded_image decode_image(std::string filename, int channels = 0)
+{
+    decoded_image image;
+    image.filename = std::move(filename);
+    image.data.reset(stbi_load(image.filename.c_str(), &image.width, &image.height, &image.components, channels));
+    if (channels)
+        image.components = channels;
+    return image;
+}
+
+// pixel format of an image with components channels, for both the internal
+// and the client format
+inline GLenum image_format(int components)
+{
+    if (components == 1)
+        return GL_RED;
+    if (components == 3)
+        return GL_RGB;
+    assert(components == 4 && "incorrect number of components");
+    return GL_RGBA;
+}
+
+// mipmaps and sampling of the GL_TEXTURE_2D bound in the current context
+inline void finish_texture()
+{
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+inline unsigned upload_image(decoded_image const & image, std::size_t indent = 0)
+{
+    fmt::print("{} upload_image: filename: {}, {}x{}\n", std::string(indent, ' '), image.filename, image.width, image.height);
+
+    unsigned textureID;
+    glGenTextures(1, &textureID);
+
+    if (image.data) {
+        GLenum const format = image_format(image.components);
+        gl().bind_texture(0, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, static_cast<int>(format), image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data.get());
+        finish_texture();
+    } else {
+        fmt::print("Texture failed to load at file: {}\n", image.filename);
+    }
+
+    return textureID;
+}
+
+} // pwgl ns
+#endif
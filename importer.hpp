@@ -0,0 +1,231 @@
+#ifndef IMPORTER_HPP
+#define IMPORTER_HPP
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "mesh_data.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlet.hpp"
+#include "obj_importer.hpp"
+#include "tangent_space.hpp"
+
+#include "fmt/format.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Assimp based import stage, produces pwgl::mesh_data without touching GL.
+
+namespace {
+
+void collect_material_textures(std::vector<pwgl::texture> & textures, aiMaterial *mat, aiTextureType type, std::string typeName, std::size_t indent = 0) {
+    fmt::print("{} {} textures: {}, typename: {}\n", std::string(indent, ' '), __func__, mat->GetTextureCount(type), typeName);
+    for (unsigned i = 0; i < mat->GetTextureCount(type); i++) {
+        aiString str;
+        mat->GetTexture(type, i, &str);
+
+        pwgl::texture texture;
+        texture.id = 0;
+        texture.type = typeName;
+        texture.path = str.C_Str();
+        textures.emplace_back(texture);
+    }
+}
+
+pwgl::mesh_data process_mesh(aiMesh *mesh, const aiScene *scene, std::size_t indent = 4)
+{
+    pwgl::mesh_data data;
+    data.vertices.reserve(mesh->mNumVertices);
+    data.indices.reserve(mesh->mNumFaces * 3);
+
+    // walk through each of the mesh's vertices
+    for(unsigned i = 0; i < mesh->mNumVertices; i++) {
+        pwgl::vertex vertex { };
+
+        // location 0: position
+        vertex.Position = {
+            mesh->mVertices[i].x,
+            mesh->mVertices[i].y,
+            mesh->mVertices[i].z
+        };
+
+        // location 1: normals
+        if (mesh->HasNormals()) {
+            vertex.Normal = {
+                mesh->mNormals[i].x,
+                mesh->mNormals[i].y,
+                mesh->mNormals[i].z
+            };
+        }
+
+        // location 2: texture coords.
+        if(mesh->mTextureCoords[0]) {
+            vertex.TexCoords = {
+                mesh->mTextureCoords[0][i].x,
+                mesh->mTextureCoords[0][i].y
+            };
+        } else {
+            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+        }
+
+        // tangent and bitangent, without aiProcess_CalcTangentSpace these
+        // come from generate_tangent_space()
+        if (mesh->mTangents && mesh->mBitangents) {
+            vertex.Tangent = {
+                mesh->mTangents[i].x,
+                mesh->mTangents[i].y,
+                mesh->mTangents[i].z
+            };
+            vertex.Bitangent = {
+                mesh->mBitangents[i].x,
+                mesh->mBitangents[i].y,
+                mesh->mBitangents[i].z
+            };
+        }
+
+        data.vertices.emplace_back(vertex);
+    }
+
+    for(unsigned i = 0; i < mesh->mNumFaces; i++) {
+        aiFace face = mesh->mFaces[i];
+        for(unsigned j = 0; j < face.mNumIndices; j++)
+            data.indices.emplace_back(face.mIndices[j]);
+    }
+    data.bounds = pwgl::compute_bounds(data.vertices);
+
+    aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+
+    // 1. diffuse maps
+    collect_material_textures(data.textures, material, aiTextureType_DIFFUSE, "texture_diffuse", indent + 4);
+    // 2. specular maps
+    collect_material_textures(data.textures, material, aiTextureType_SPECULAR, "texture_specular", indent + 4);
+    // 3. normal maps
+    collect_material_textures(data.textures, material, aiTextureType_HEIGHT, "texture_normal", indent + 4);
+    // 4. height maps
+    collect_material_textures(data.textures, material, aiTextureType_AMBIENT, "texture_height", indent + 4);
+
+    fmt::print("{} process_mesh: vertices: {}, indices: {}, textures: {}\n",
+               std::string(indent, ' '),  data.vertices.size(), data.indices.size(), data.textures.size());
+
+    return data;
+}
+
+// depth first, so the nodes come out parents first and every subtree
+// contiguous. a mesh referenced by several nodes is imported once per node.
+void processNode(std::vector<pwgl::mesh_data> & meshes, std::vector<pwgl::node_data> & nodes, aiNode *node, const aiScene *scene,
+                 std::uint32_t parent = pwgl::no_node, int child = 0, int max_children = 0, std::size_t indent = 4)
+{
+    fmt::print("{} [{}/{}]processNode, meshes: {}, children: {}\n", std::string(indent, ' '),
+               child, max_children, node->mNumMeshes, node->mNumChildren);
+
+    // shear, if any, does not survive the decomposition
+    aiVector3D scaling;
+    aiQuaternion rotation;
+    aiVector3D position;
+    node->mTransformation.Decompose(scaling, rotation, position);
+    auto const index = static_cast<std::uint32_t>(nodes.size());
+    nodes.push_back({ node->mName.C_Str(), parent, { position.x, position.y, position.z },
+                      { rotation.w, rotation.x, rotation.y, rotation.z }, { scaling.x, scaling.y, scaling.z } });
+
+    for (unsigned i = 0; i < node->mNumMeshes; i++) {
+        aiMesh * mesh = scene->mMeshes[node->mMeshes[i]];
+        meshes.emplace_back(
+            process_mesh(mesh, scene, indent + 4)
+        ).node = index;
+    }
+
+    for (unsigned i = 0; i < node->mNumChildren; i++) {
+        processNode(meshes, nodes, node->mChildren[i], scene, index,
+                    int(i), int(node->mNumChildren), indent + 4);
+    }
+}
+
+} // anon ns
+
+namespace pwgl {
+
+// post processing applied to every imported model, also part of the bake key
+inline constexpr unsigned import_flags =
+    aiProcess_Triangulate
+  | aiProcess_JoinIdenticalVertices
+  | aiProcess_GenSmoothNormals
+  | aiProcess_FlipUVs
+  | aiProcess_CalcTangentSpace;
+
+// optimize: reorder triangles/vertices for the post transform cache and
+// vertex fetch (see mesh_optimizer.hpp). nodes: receives the node
+// hierarchy, mesh_data::node indexes it.
+inline std::vector<mesh_data> import_model(std::string const & path, unsigned flags = import_flags, bool optimize = true,
+                                           std::vector<node_data> * nodes = nullptr) {
+    fmt::print("import_model: name: {}\n", path);
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, flags);
+    if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        fmt::print("ERROR::ASSIMP:: {}\n", importer.GetErrorString());
+        throw std::logic_error("could not import model");
+    }
+
+    std::vector<mesh_data> meshes;
+    std::vector<node_data> hierarchy;
+    processNode(meshes, hierarchy, scene->mRootNode, scene);
+    if (optimize) {
+        for (auto & mesh : meshes)
+            optimize_mesh(mesh);
+    }
+    if (nodes)
+        *nodes = std::move(hierarchy);
+    return meshes;
+}
+
+// who computes smooth normals and tangents of Assimp imports: parallel
+// runs generate_tangent_space() (tangent_space.hpp) on the worker pool,
+// assimp keeps aiProcess_GenSmoothNormals / aiProcess_CalcTangentSpace.
+// the OBJ fast path always uses tangent_space.hpp.
+enum class tangent_generator {
+    parallel,
+    assimp,
+};
+
+inline constexpr unsigned tangent_flags = aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace;
+
+// .obj files go through the OBJ fast path (obj_importer.hpp), everything
+// else through Assimp with import_flags. the meshlets (meshlet.hpp) and
+// the LOD chain (mesh_simplifier.hpp) are built last, from the final index
+// order. nodes: as import_model(), OBJ files have a single root node.
+inline std::vector<mesh_data> import_file(std::string const & path, bool optimize = true,
+                                          tangent_generator generator = tangent_generator::parallel,
+                                          std::vector<node_data> * nodes = nullptr) {
+    std::vector<mesh_data> meshes;
+    if (is_obj_file(path)) {
+        meshes = import_obj(path, optimize);
+        if (nodes)
+            *nodes = { node_data { "root" } };
+    } else if (generator == tangent_generator::assimp) {
+        meshes = import_model(path, import_flags, optimize, nodes);
+    } else {
+        meshes = import_model(path, import_flags & ~tangent_flags, false, nodes);
+        generate_tangent_space(meshes);
+        if (optimize) {
+            for (auto & mesh : meshes)
+                optimize_mesh(mesh);
+        }
+    }
+    build_meshlets(meshes);
+    build_lods(meshes);
+    return meshes;
+}
+
+// bake key flags (mesh_cache::cache_key) of import_file(path, generator)
+inline unsigned import_key(std::string const & path, tangent_generator generator = tangent_generator::parallel) {
+    if (is_obj_file(path))
+        return obj_import_key;
+    return generator == tangent_generator::assimp ? import_flags : import_flags & ~tangent_flags;
+}
+
+} // pwgl ns
+#endif
@@ -0,0 +1,277 @@
+#ifndef INDIRECT_RENDERER_HPP
+#define INDIRECT_RENDERER_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frame_stats.hpp"
+#include "frustum.hpp"
+#include "gl_state.hpp"
+#include "lod_selection.hpp"
+#include "model.hpp"
+#include "ring_buffer.hpp"
+#include "shader.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Whole scene submission: every visible (mesh, instance) pair becomes one
+// DrawElementsIndirectCommand, and the commands of one model sharing index
+// type and textures are issued with a single glMultiDrawElementsIndirect.
+// Without GL 4.3 / ARB_multi_draw_indirect the same command list is walked
+// with glDrawElementsInstancedBaseVertex, re-pointing the instance
+// attributes for each command instead of using baseInstance.
+//
+// The per instance model matrix comes from the vertex_arena instance
+// attributes. The mesh's node transform and, for vertex_format::packed,
+// the per mesh dequantization are folded into that matrix, so meshes of
+// different nodes and ranges still share a bucket. Textures stay plain GL_TEXTURE_2D bindings (one bind per bucket):
+// the context is GL 3.3 core, which has neither bindless handles nor a way
+// to index texture arrays per draw.
+
+namespace pwgl {
+
+// layout fixed by GL for GL_DRAW_INDIRECT_BUFFER
+struct draw_elements_indirect_command {
+    std::uint32_t count;
+    std::uint32_t instance_count;
+    std::uint32_t first_index;
+    std::int32_t base_vertex;
+    std::uint32_t base_instance;
+};
+static_assert(sizeof(draw_elements_indirect_command) == 20);
+
+struct indirect_renderer {
+    // instances: receives the instance transforms and draw commands of
+    // every flush()
+    explicit indirect_renderer(ring_buffer & instances)
+        : stream(instances)
+        , multi_draw(GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance))
+    {
+        fmt::print("[~] indirect_renderer: {}\n", multi_draw ? "glMultiDrawElementsIndirect" : "fallback loop");
+    }
+    indirect_renderer(indirect_renderer const &) = delete;
+    indirect_renderer & operator=(indirect_renderer const &) = delete;
+
+    // queues one draw of model per transform, culling every mesh instance
+    // against the frustum of view_projection. with lods every mesh instance
+    // is drawn at the level select_lod() picks for it, the levels of the
+    // previous submit of the model with the same instance ids giving the
+    // hysteresis. instances: a stable id per transform (a scene node, an
+    // instance index), by default its position. the model must outlive
+    // flush().
+    void submit(pwgl::model & model, std::span<glm::mat4 const> transforms, glm::mat4 const & view_projection,
+                lod_policy const * lods = nullptr, std::span<std::uint32_t const> instances = { }) {
+        std::size_t const slot = model_slot(model);
+        auto & entry = models[slot];
+        bool const packed = model.arena.format == vertex_format::packed;
+        std::size_t const mesh_count = model.meshes.size();
+
+        // 0: culled, otherwise 1 + level
+        visibility.resize(transforms.size() * mesh_count);
+        for (std::size_t t = 0; t < transforms.size(); ++t) {
+            pwgl::cull_boxes(pwgl::frustum::from(view_projection * transforms[t]), model.bounds, visible);
+            std::size_t const id = instances.empty() ? t : instances[t];
+            if (lods && entry.levels.size() < (id + 1) * mesh_count)
+                entry.levels.resize((id + 1) * mesh_count, 0);
+            for (std::size_t m = 0; m < mesh_count; ++m) {
+                std::size_t const i = t * mesh_count + m;
+                visibility[i] = visible[m];
+                if (!lods || !visible[m])
+                    continue;
+                auto const & mesh = model.meshes[m];
+                auto & level = entry.levels[id * mesh_count + m];
+                level = static_cast<std::uint8_t>(select_lod(mesh.lod_errors, mesh.bounds, model.mesh_transform(m, transforms[t]), *lods, level));
+                visibility[i] = static_cast<std::uint8_t>(1 + level);
+            }
+        }
+
+        // instances are laid out mesh and level major, so every command
+        // addresses a contiguous run of the model's instance stream
+        for (std::size_t m = 0; m < mesh_count; ++m) {
+            std::size_t const levels = lods ? std::min<std::size_t>(model.meshes[m].lod_errors.size(), max_levels) : 1;
+            for (std::size_t level = 0; level < levels; ++level) {
+                auto const & range = model.meshes[m].lod_range(level);
+                // node transform and dequantization, per mesh
+                glm::mat4 local = model.nodes.world[model.meshes[m].node];
+                if (packed)
+                    local = local * glm::scale(glm::translate(glm::mat4(1.0f), range.position_offset), range.position_scale);
+
+                std::size_t const first = entry.instances.size();
+                for (std::size_t t = 0; t < transforms.size(); ++t) {
+                    if (visibility[t * mesh_count + m] != 1 + level)
+                        continue;
+                    entry.instances.push_back(transforms[t] * local);
+                }
+                std::size_t const count = entry.instances.size() - first;
+                if (!count)
+                    continue;
+
+                draws.push_back({
+                    sort_key(slot, range.index_type, entry.materials[m], m * max_levels + level),
+                    slot, m,
+                    { static_cast<std::uint32_t>(range.index_count), static_cast<std::uint32_t>(count),
+                      static_cast<std::uint32_t>(range.index_offset / index_size(range.index_type)), range.base_vertex,
+                      static_cast<std::uint32_t>(first) }
+                });
+            }
+        }
+    }
+
+    // draws everything submitted since the last flush
+    void flush(pwgl::shader & shader) {
+        std::sort(std::begin(draws), std::end(draws), [](auto const & a, auto const & b) {
+            return a.key < b.key;
+        });
+        commands.clear();
+        for (auto const & d : draws)
+            commands.push_back(d.command);
+
+        std::size_t command_base = 0;
+        if (multi_draw && !commands.empty()) {
+            command_base = stream.write(commands.data(), commands.size() * sizeof(draw_elements_indirect_command)).offset;
+            stream.flush();
+            gl().bind_buffer(GL_DRAW_INDIRECT_BUFFER, stream.buffer);
+        }
+
+        shader.set(shader.uniform("instanced"), 1);
+        // identity dequantization, folded into the instance matrices
+        shader.set(shader.uniform("position_offset"), glm::vec3(0.0f));
+        shader.set(shader.uniform("position_scale"), glm::vec3(1.0f));
+
+        std::size_t begin = 0;
+        while (begin < draws.size()) {
+            auto & entry = models[draws[begin].model];
+            auto & model = *entry.model;
+            model.arena.bind();
+            model.arena.begin_instances(stream, entry.instances);
+            shader.set(shader.uniform("vertex_packed"), model.arena.format == vertex_format::packed ? 1 : 0);
+
+            // one bucket per (model, index type, material)
+            std::size_t const model_end = end_of(begin, model_mask);
+            while (begin < model_end) {
+                std::size_t const end = end_of(begin, bucket_mask);
+                auto const & first = draws[begin];
+                model.meshes[first.mesh].bind_textures(shader);
+                unsigned const index_type = model.meshes[first.mesh].range.index_type;
+
+                if (multi_draw) {
+                    ++stats().draw_calls;
+                    stats().draw_commands += end - begin;
+                    glMultiDrawElementsIndirect(GL_TRIANGLES, index_type,
+                                                (void*)(command_base + begin * sizeof(draw_elements_indirect_command)),
+                                                static_cast<int>(end - begin), 0);
+                } else {
+                    for (std::size_t i = begin; i < end; ++i) {
+                        auto const & c = commands[i];
+                        model.arena.instance_offset(c.base_instance);
+                        ++stats().draw_calls;
+                        ++stats().draw_commands;
+                        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<int>(c.count), index_type,
+                                                          (void*)(c.first_index * index_size(index_type)),
+                                                          static_cast<int>(c.instance_count), c.base_vertex);
+                    }
+                    model.arena.instance_offset(0);
+                }
+                begin = end;
+            }
+            model.arena.end_instances();
+        }
+
+        shader.set(shader.uniform("instanced"), 0);
+
+        // keep the capacity, steady state frames do not allocate
+        draws.clear();
+        for (auto & entry : models)
+            entry.instances.clear();
+    }
+
+    ring_buffer & stream;
+    bool multi_draw { };
+
+private:
+    struct draw_record {
+        std::uint64_t key;
+        std::size_t model;
+        std::size_t mesh;
+        draw_elements_indirect_command command;
+    };
+
+    struct model_entry {
+        pwgl::model * model { };
+        std::size_t revision { };
+        std::vector<std::uint32_t> materials;   // per mesh: index of the first mesh with the same textures
+        std::vector<glm::mat4> instances;
+        std::vector<std::uint8_t> levels;       // per (instance id, mesh) of the last submit with lods
+    };
+
+    // levels per mesh in the sort key, the import builds at most 5
+    static constexpr std::size_t max_levels = 8;
+
+    // model (16 bits) | index type (1) | material (24) | mesh, level (23)
+    static constexpr std::uint64_t model_mask = ~((std::uint64_t(1) << 48) - 1);
+    static constexpr std::uint64_t bucket_mask = ~((std::uint64_t(1) << 23) - 1);
+
+    static std::uint64_t sort_key(std::size_t model, unsigned index_type, std::uint32_t material, std::size_t draw) {
+        return std::uint64_t(model) << 48
+             | std::uint64_t(index_type == GL_UNSIGNED_INT) << 47
+             | std::uint64_t(material & 0xffffff) << 23
+             | std::uint64_t(draw & 0x7fffff);
+    }
+
+    static std::size_t index_size(unsigned index_type) {
+        return index_type == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(unsigned);
+    }
+
+    std::size_t end_of(std::size_t begin, std::uint64_t mask) const {
+        std::size_t end = begin + 1;
+        while (end < draws.size() && (draws[end].key & mask) == (draws[begin].key & mask))
+            ++end;
+        return end;
+    }
+
+    // models keep their slot (and sort position) across frames, materials
+    // are resolved on first use and again when the model changed
+    std::size_t model_slot(pwgl::model & model) {
+        std::size_t slot = 0;
+        while (slot < models.size() && models[slot].model != &model)
+            ++slot;
+        if (slot == models.size())
+            models.emplace_back().model = &model;
+
+        auto & entry = models[slot];
+        if (entry.materials.size() == model.meshes.size() && entry.revision == model.revision)
+            return slot;
+        entry.revision = model.revision;
+        entry.levels.clear();
+        entry.materials.resize(model.meshes.size());
+        for (std::size_t m = 0; m < model.meshes.size(); ++m) {
+            entry.materials[m] = static_cast<std::uint32_t>(m);
+            for (std::size_t n = 0; n < m; ++n) {
+                if (same_textures(model.meshes[n], model.meshes[m])) {
+                    entry.materials[m] = static_cast<std::uint32_t>(n);
+                    break;
+                }
+            }
+        }
+        return slot;
+    }
+
+    static bool same_textures(pwgl::mesh const & a, pwgl::mesh const & b) {
+        return std::equal(std::begin(a.textures), std::end(a.textures), std::begin(b.textures), std::end(b.textures),
+                          [](auto const & x, auto const & y) { return x.id == y.id && x.type == y.type; });
+    }
+
+    std::vector<model_entry> models;
+    std::vector<draw_record> draws;
+    std::vector<draw_elements_indirect_command> commands;
+    std::vector<std::uint8_t> visible;
+    std::vector<std::uint8_t> visibility;
+};
+
+} // pwgl ns
+#endif
@@ -0,0 +1,86 @@
+#ifndef LOD_SELECTION_HPP
+#define LOD_SELECTION_HPP
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <span>
+
+// Screen space error LOD selection, GL free. A level is good enough when
+// its error (mesh_lod::error, scaled to world units) projects to at most
+// threshold pixels at the distance of the nearest point of the mesh's
+// bounding sphere. The coarsest good enough level is taken, but a switch
+// to a coarser level than the current one needs a margin (hysteresis), so
+// meshes near a boundary do not flip between levels every frame. Switches
+// to finer levels happen at once.
+
+namespace pwgl {
+
+struct lod_policy {
+    float pixels_per_unit { };      // projected size of one unit at distance 1
+    float threshold { 1.0f };       // pixels
+    float hysteresis { 0.25f };     // coarser only below threshold * (1 - hysteresis)
+    glm::vec3 viewer { 0.0f };      // world space
+
+    // perspective projection: pixels_per_unit = cot(fovy / 2) * height / 2
+    static lod_policy from(glm::mat4 const & projection, float viewport_height, glm::vec3 viewer, float threshold = 1.0f) {
+        lod_policy p;
+        p.pixels_per_unit = projection[1][1] * viewport_height * 0.5f;
+        p.threshold = threshold;
+        p.viewer = viewer;
+        return p;
+    }
+};
+
+// largest axis scale of a transform, mesh units to world units
+inline float max_scale(glm::mat4 const & m) {
+    auto column = [&m](int i) {
+        return glm::dot(glm::vec3(m[i]), glm::vec3(m[i]));
+    };
+    return std::sqrt(std::max({ column(0), column(1), column(2) }));
+}
+
+// errors: per level in world units, errors[0] the base mesh (0).
+// distance: from the viewer to the nearest point of the mesh.
+inline std::size_t select_lod(std::span<float const> errors, float distance, lod_policy const & policy, std::size_t current) {
+    if (errors.size() < 2)
+        return 0;
+    current = std::min(current, errors.size() - 1);
+    float const scale = policy.pixels_per_unit / std::max(distance, 1e-4f);
+
+    std::size_t level = 0;
+    for (std::size_t l = errors.size() - 1; l > 0; --l) {
+        if (errors[l] * scale <= policy.threshold) {
+            level = l;
+            break;
+        }
+    }
+    while (level > current && errors[level] * scale > policy.threshold * (1.0f - policy.hysteresis))
+        --level;
+    return level;
+}
+
+// select_lod() for a mesh with bounds drawn with transform, errors in mesh
+// units as in pwgl::mesh::lod_errors
+inline std::size_t select_lod(std::span<float const> errors, bounding_volume const & bounds, glm::mat4 const & transform,
+                              lod_policy const & policy, std::size_t current) {
+    if (errors.size() < 2)
+        return 0;
+    float const scale = max_scale(transform);
+    glm::vec3 const center(transform * glm::vec4(bounds.center, 1.0f));
+    float const distance = glm::distance(center, policy.viewer) - bounds.radius * scale;
+
+    // at most 8 levels, the import builds up to 5
+    float world[8];
+    std::size_t const levels = std::min<std::size_t>(errors.size(), 8);
+    for (std::size_t l = 0; l < levels; ++l)
+        world[l] = errors[l] * scale;
+    return select_lod(std::span<float const>(world, levels), distance, policy, current);
+}
+
+} // pwgl ns
+#endif
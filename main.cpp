@@ -2,6 +2,14 @@
 
 #include "opengl_support.hpp"
 #include "model.hpp"
+#include "frame_uniforms.hpp"
+#include "hiz.hpp"
+#include "bvh.hpp"
+#include "indirect_renderer.hpp"
+#include "model_loader.hpp"
+#include "occlusion.hpp"
+#include "render_queue.hpp"
+#include "upload_thread.hpp"
 //#include "shader.hpp"
 //#include "mesh.hpp"
 //#include "model.hpp"
@@ -13,6 +21,10 @@
 
 #include "camera.hpp"
 
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <optional>
 #include <vector>
 #include <fstream>
 #include <string>
@@ -22,6 +34,27 @@
 
 // globals:
 pwgl::gls gls{1920, 1080};
+std::atomic<std::size_t> allocations { };
+bool pick_requested = false;
+
+// count every heap allocation, shown per frame in the fps overlay
+void * operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void * p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+    std::free(p);
+}
 
 namespace fmt {
 
@@ -100,7 +133,14 @@ void mouse_callback(GLFWwindow * /* window */, double xpos, double ypos)
     gls.camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
-void update_fps_counter(GLFWwindow * window)
+// the cursor is captured, picks what is under the center of the window
+void mouse_button_callback(GLFWwindow * /* window */, int button, int action, int /* mods */)
+{
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+        pick_requested = true;
+}
+
+void update_fps_counter(GLFWwindow * window, std::size_t frame_allocations, pwgl::frame_stats const & frame)
 {
     static double previous_seconds = glfwGetTime();
     static int frame_count;
@@ -109,7 +149,9 @@ void update_fps_counter(GLFWwindow * window)
     if (elapsed_seconds > 0.25) {
         previous_seconds = current_seconds;
         double fps = (double)frame_count / elapsed_seconds;
-        glfwSetWindowTitle(window, fmt::format("opengl @ fps: {:.2f}", fps).c_str());
+        glfwSetWindowTitle(window, fmt::format("opengl @ fps: {:.2f}, allocs/frame: {}, draw calls/frame: {} ({} meshes), state changes: {} ({} avoided), clusters culled: {}, instances culled: {} (+{} occluded), fence wait: {:.3f} ms, uploads: {:.2f} ms",
+                                               fps, frame_allocations, frame.draw_calls, frame.draw_commands,
+                                               frame.state_changes, frame.state_changes_avoided, frame.clusters_culled, frame.instances_culled, frame.instances_occluded, frame.fence_wait_ms, frame.upload_ms).c_str());
         frame_count = 0;
     }
     frame_count++;
@@ -242,6 +284,7 @@ int main(int argc, char ** argv)
     fmt::print("resolution: {}x{}\n", gls.width, gls.height);
     glfwSetCursorPosCallback(gls.window, mouse_callback);
     glfwSetScrollCallback(gls.window, scroll_callback);
+    glfwSetMouseButtonCallback(gls.window, mouse_button_callback);
 
     auto create_shaders = [](std::string file) {
         auto source = pwgl::parse_shaders(file);
@@ -262,7 +305,49 @@ int main(int argc, char ** argv)
         return 1;
     }
 
-    pwgl::model backpack_model(argc < 2 ? "resources/models/nanosuit/nanosuit.obj" : argv[1]);
+    // options after the model file: --packed (vertex_format::packed),
+    // --indirect (submission through pwgl::indirect_renderer),
+    // --upload-thread (GL uploads on a shared context, pwgl::upload_thread),
+    // --assimp-tangents (Assimp's normals/tangents, pwgl::tangent_generator),
+    // --clusters (meshlet culled draws, pwgl::model::draw_clusters),
+    // --no-lod (always the base meshes, no pwgl::select_lod),
+    // --instances (a grid of 32x32 spinning copies of the model, culled
+    // through a pwgl::bvh),
+    // --occlusion (the nearest instances occlude the others, pwgl::hiz_culler),
+    // --occlusion-cpu (the same on a software rasterizer, pwgl::occlusion_culler)
+    bool packed = false;
+    bool indirect = false;
+    bool threaded_uploads = false;
+    bool assimp_tangents = false;
+    bool clusters = false;
+    bool lod = true;
+    bool instances = false;
+    bool gpu_occlusion = false;
+    bool cpu_occlusion = false;
+    for (int i = 2; i < argc; ++i) {
+        packed = packed || std::string_view(argv[i]) == "--packed";
+        indirect = indirect || std::string_view(argv[i]) == "--indirect";
+        threaded_uploads = threaded_uploads || std::string_view(argv[i]) == "--upload-thread";
+        assimp_tangents = assimp_tangents || std::string_view(argv[i]) == "--assimp-tangents";
+        clusters = clusters || std::string_view(argv[i]) == "--clusters";
+        lod = lod && std::string_view(argv[i]) != "--no-lod";
+        instances = instances || std::string_view(argv[i]) == "--instances";
+        gpu_occlusion = gpu_occlusion || std::string_view(argv[i]) == "--occlusion";
+        cpu_occlusion = cpu_occlusion || std::string_view(argv[i]) == "--occlusion-cpu";
+    }
+    std::optional<pwgl::upload_thread> uploads;
+    if (threaded_uploads)
+        uploads.emplace(gls.window);
+    // loads in the background, the model draws progressively while the
+    // loader uploads its meshes and textures
+    pwgl::model_loader loader(std::chrono::milliseconds(2), uploads ? &*uploads : nullptr);
+    auto const backpack_model = loader.load(argc < 2 ? "resources/models/nanosuit/nanosuit.obj" : argv[1],
+                                            packed ? pwgl::vertex_format::packed : pwgl::vertex_format::full,
+                                            assimp_tangents ? pwgl::tangent_generator::assimp : pwgl::tangent_generator::parallel);
+    // per frame dynamic data: camera block, instance transforms, draw commands
+    pwgl::ring_buffer stream(4 << 20);
+    pwgl::indirect_renderer renderer(stream);
+    pwgl::render_queue queue;
 
 
     //---[ lamp ]---------------------------------------------------------------
@@ -281,72 +366,203 @@ int main(int argc, char ** argv)
         lamp_shader.ebo_alloc(lamp_object.indices);
     }
 
+    //---[ occlusion ]----------------------------------------------------------
+    auto hiz_downsample_shader = create_shaders("resources/shaders/hiz_downsample.glsl");
+    auto hiz_cull_shader = [] {
+        auto source = pwgl::parse_shaders("resources/shaders/hiz_cull.glsl");
+        return pwgl::create_shader(source["vertex"].str(), source["fragment"].str(), pwgl::hiz_culler::feedback_varyings);
+    }();
+    // half the window, the cpu one a quarter
+    std::optional<pwgl::hiz_culler> hiz;
+    if (gpu_occlusion && hiz_downsample_shader.id && hiz_cull_shader.id)
+        hiz.emplace(stream, hiz_downsample_shader, hiz_cull_shader, std::uint32_t(gls.width) / 2, std::uint32_t(gls.height) / 2);
+    pwgl::occlusion_culler software_occlusion;
+
+    // uniform locations, resolved once:
+    // (view and projection come from the shared frame uniform block)
+    auto const model_u = model_shader.uniform("model");
+    auto const lamp_model_u = lamp_shader.uniform("model");
+
+    // placement of the model and the lamp
+    pwgl::scene_graph scene;
+    auto const model_node = scene.add(pwgl::no_node, glm::vec3(0.0f, -2.8f, -5.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.5f));
+    auto const lamp_node = scene.add(pwgl::no_node, glm::vec3(1.0f, 3.0f, -1.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.1f));
+
+    // the nodes drawing the model: the model node alone, or the grid.
+    // their world bounds are refit into the bvh every frame.
+    std::vector<std::uint32_t> instance_nodes { model_node };
+    if (instances) {
+        constexpr int grid = 32;
+        constexpr float spacing = 4.0f;
+        instance_nodes.clear();
+        for (int z = 0; z < grid; ++z) {
+            for (int x = 0; x < grid; ++x) {
+                glm::vec3 const position((float(x) - grid / 2) * spacing, -2.8f, -5.0f - float(z) * spacing);
+                instance_nodes.push_back(scene.add(pwgl::no_node, position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.5f)));
+            }
+        }
+    }
+    pwgl::bvh instance_tree;
+    std::vector<pwgl::bounding_volume> instance_bounds(instance_nodes.size());
+    std::vector<std::uint32_t> visible_instances;
+    std::vector<std::uint32_t> occluders;
+    std::vector<glm::mat4> visible_transforms;
+    visible_instances.reserve(instance_nodes.size());
+    visible_transforms.reserve(instance_nodes.size());
+    constexpr std::size_t occluder_count = 8;
+    occluders.reserve(instance_nodes.size());
+
     double lastFrame = 0.0f;
+    std::size_t frame_allocations = 0;
+    pwgl::frame_stats frame;
     while(!glfwWindowShouldClose(gls.window)) {
         double currentFrame = glfwGetTime();
         gls.deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         process_input(gls.window);
-        update_fps_counter(gls.window);
+        update_fps_counter(gls.window, frame_allocations, frame);
+        pwgl::stats().reset();
+        std::size_t const allocations_before = allocations.load(std::memory_order_relaxed);
+        stream.begin_frame();
+        loader.update();
 
         // render:
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // camera, written once for every program:
+        glm::mat4 const view = gls.camera.get_view_matrix();
+        glm::mat4 const projection = glm::perspective(gls.camera.get_zoom(), gls.width / gls.height, 0.1f, 100.0f);
+        {
+            pwgl::frame_uniforms camera;
+            camera.view = view;
+            camera.projection = projection;
+            camera.view_projection = projection * view;
+            camera.camera_position = gls.camera.get_position();
+            camera.time = static_cast<float>(currentFrame);
+            camera.viewport = { gls.width, gls.height, 1.0f / gls.width, 1.0f / gls.height };
+            pwgl::bind_frame_uniforms(stream, camera);
+        }
+
  //---[ model ]------------------------------------------
         {
-            glm::vec3 modelpos{0.0f, -2.8f, -5.0f};
-
-            // MVP:
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, modelpos);
-            //model = glm::rotate(model, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            model = glm::rotate(model, (float)glfwGetTime() / 1.0f, glm::vec3(0.0f, 0.1f, 0.0f));
-            model = glm::scale(model, glm::vec3{0.5f});
-
-            glm::mat4 view;
-            view = gls.camera.get_view_matrix();
-
-            glm::mat4 projection = glm::perspective(gls.camera.get_zoom(), gls.width / gls.height, 0.1f, 100.0f);
-
-            // model uniforms:
-            model_shader.use();
-            model_shader.set(model, "model");
-            model_shader.set(view, "view");
-            model_shader.set(projection, "projection");
-            model_shader.use();
-            backpack_model.draw(model_shader);
+            // the model nodes spin, the model's own nodes sit below them
+            for (std::size_t i = 0; i < instance_nodes.size(); ++i)
+                scene.set_rotation(instance_nodes[i], glm::angleAxis((float)glfwGetTime() + float(i) * 0.1f, glm::vec3(0.0f, 1.0f, 0.0f)));
+            scene.update();
+            backpack_model->update_nodes();
+
+            // instances in the frustum, through the bvh over their world
+            // bounds
+            auto const extent = backpack_model->extent();
+            for (std::size_t i = 0; i < instance_nodes.size(); ++i)
+                instance_bounds[i] = pwgl::transform_bounds(extent, scene.world[instance_nodes[i]]);
+            instance_tree.refit(instance_bounds);
+            visible_instances.clear();
+            instance_tree.cull(pwgl::frustum::from(projection * view), visible_instances);
+            pwgl::stats().instances_culled += instance_nodes.size() - visible_instances.size();
+
+            // the nearest visible instances occlude the rest
+            if (hiz || cpu_occlusion) {
+                glm::vec3 const eye = gls.camera.get_position();
+                auto const distance = [&](std::uint32_t i) {
+                    return glm::distance(eye, instance_bounds[i].center);
+                };
+                occluders.assign(visible_instances.begin(), visible_instances.end());
+                auto const nearest = occluders.begin() + static_cast<std::ptrdiff_t>(std::min(occluder_count, occluders.size()));
+                std::partial_sort(occluders.begin(), nearest, occluders.end(), [&](std::uint32_t a, std::uint32_t b) {
+                    return distance(a) < distance(b);
+                });
+                occluders.erase(nearest, occluders.end());
+            }
+            std::size_t const before_occlusion = visible_instances.size();
+            if (hiz) {
+                // depth prepass of the occluders, the verdicts used are
+                // those of the previous frame
+                hiz->begin_occluders();
+                for (auto i : occluders)
+                    queue.submit(*backpack_model, model_shader, model_u, scene.world[instance_nodes[i]], view, projection, pwgl::render_pass::opaque);
+                queue.execute();
+                hiz->end_occluders();
+                hiz->test(instance_bounds, projection * view);
+                if (hiz->visible.size() == instance_bounds.size())
+                    std::erase_if(visible_instances, [&](std::uint32_t i) { return !hiz->visible[i]; });
+            } else if (cpu_occlusion) {
+                software_occlusion.begin(std::uint32_t(gls.width) / 4, std::uint32_t(gls.height) / 4, projection * view);
+                for (auto i : occluders) {
+                    for (std::size_t m = 0; m < backpack_model->meshes.size(); ++m) {
+                        auto const & mesh = backpack_model->meshes[m];
+                        software_occlusion.add_occluder(mesh.vertices, mesh.indices, backpack_model->mesh_transform(m, scene.world[instance_nodes[i]]));
+                    }
+                }
+                software_occlusion.end();
+                std::erase_if(visible_instances, [&](std::uint32_t i) { return software_occlusion.occluded(instance_bounds[i]); });
+            }
+            pwgl::stats().instances_occluded += before_occlusion - visible_instances.size();
+            visible_transforms.clear();
+            for (auto i : visible_instances)
+                visible_transforms.push_back(scene.world[instance_nodes[i]]);
+
+            if (pick_requested) {
+                pick_requested = false;
+                auto const ray = gls.camera.get_ray(gls.width * 0.5f, gls.height * 0.5f, gls.width, gls.height, projection);
+                // t is in units of the ray direction, near to far plane
+                if (auto const hit = instance_tree.raycast(ray, 1.0f))
+                    fmt::print("[~] picked instance {} at {}\n", hit.item, ray.origin + ray.direction * hit.t);
+                else
+                    fmt::print("[~] picked nothing\n");
+            }
+
+            // levels with at most one pixel of error at the current zoom
+            auto const lods = pwgl::lod_policy::from(projection, gls.height, gls.camera.get_position());
+
+            // the model matrix is set per draw by the queue:
+            if (indirect) {
+                model_shader.use();
+                renderer.submit(*backpack_model, visible_transforms, projection * view, lod ? &lods : nullptr, visible_instances);
+                renderer.flush(model_shader);
+            } else if (clusters) {
+                model_shader.use();
+                for (auto const & model : visible_transforms)
+                    backpack_model->draw_clusters(model_shader, stream, model_u, model, projection * view, gls.camera.get_position());
+            } else {
+                for (std::size_t i = 0; i < visible_transforms.size(); ++i)
+                    queue.submit(*backpack_model, model_shader, model_u, visible_transforms[i], view, projection,
+                                 pwgl::render_pass::opaque, lod ? &lods : nullptr, visible_instances[i]);
+            }
         }
  //---[ lamp ]-------------------------------------------
         {
-            glm::vec3 lightpos{1.0f, 3.0f, -1.0f};
-
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, lightpos);
-            model = glm::scale(model, glm::vec3{0.1f});
-
-            glm::mat4 view;
-            view = gls.camera.get_view_matrix();
-
-            glm::mat4 projection = glm::perspective(gls.camera.get_zoom(), gls.width / gls.height, 0.1f, 100.0f);
-            // use model_shader program:
-            lamp_shader.use();
-            lamp_shader.set(model, "model");
-            lamp_shader.set(view, "view");
-            lamp_shader.set(projection, "projection");
-
-            // draw light box:
-            for (auto vao : lamp_shader.vaos)
-                glBindVertexArray(vao);
-            glDrawElements(GL_TRIANGLES, static_cast<int>(lamp_object.indices.size() * 3), GL_UNSIGNED_INT, 0);
+            glm::mat4 const & model = scene.world[lamp_node];
+            glm::vec3 const lightpos(model[3]);
+
+            // queue light box:
+            pwgl::render_item lamp;
+            lamp.shader = &lamp_shader;
+            lamp.vao = lamp_shader.vaos.back();
+            lamp.range.index_count = lamp_object.indices.size() * 3;
+            lamp.model_u = lamp_model_u;
+            lamp.model = model;
+            queue.submit(lamp, -(view * glm::vec4(lightpos, 1.0f)).z);
         }
 
+        queue.execute();
+        stream.end_frame();
+        if constexpr (pwgl::gl_state::validating) {
+            if (!pwgl::gl().validate())
+                throw std::logic_error("GL state shadow out of sync");
+        }
+
+        frame_allocations = allocations.load(std::memory_order_relaxed) - allocations_before;
+        frame = pwgl::stats();
+
         glfwSwapBuffers(gls.window);
         glfwPollEvents();
     }
 
     fmt::print("exit\n");
+    uploads.reset();
     glfwTerminate();
     return 0;
 }
@@ -4,101 +4,118 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 //#include "stb_image.h"
+#include "mesh_data.hpp"
+#include "shader.hpp"
+#include "vertex_arena.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 namespace pwgl {
 
-struct vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-    glm::vec3 Tangent;
-    glm::vec3 Bitangent;
+// texture bound to a sampler: unit, GL texture name, sampler uniform location
+struct texture_binding {
+    int unit;
+    unsigned texture;
+    int location;
 };
 
-struct texture {
-    unsigned int id;
-    std::string type;
-    std::string path;
+// textures of a mesh resolved against one shader program
+struct material_binding {
+    unsigned program { };
+    std::size_t count { };
+    std::array<texture_binding, 16> slots { };
+    uniform_handle position_offset;
+    uniform_handle position_scale;
 };
 
 class mesh {
 public:
-    mesh(std::vector<vertex> vertices, std::vector<unsigned> indices, std::vector<texture> textures)
-        : vertices(vertices)
-        , indices(indices)
-        , textures(textures)
+    // lods: the ranges of data.lods in the arena
+    mesh(mesh_data data, mesh_range range, std::vector<mesh_range> lods = { })
+        : vertices(std::move(data.vertices))
+        , indices(std::move(data.indices))
+        , textures(std::move(data.textures))
+        , bounds(data.bounds)
+        , meshlets(std::move(data.meshlets))
+        , range(range)
+        , node(data.node)
+        , lod_ranges(std::move(lods))
     {
-        glGenVertexArrays(1, &VAO);
-        glBindVertexArray(VAO);
-
-        unsigned VBO;
-        glGenBuffers(1, &VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertex), &vertices[0], GL_STATIC_DRAW);
-
-        unsigned EBO;
-        glGenBuffers(1, &EBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, Bitangent));
-
-        glBindVertexArray(0);
+        lod_errors.push_back(0.0f);
+        for (std::size_t i = 0; i < data.lods.size() && i < lod_ranges.size(); ++i)
+            lod_errors.push_back(data.lods[i].error);
     }
 
-    ~mesh() {
-        //fmt::print("~mesh()\n");
-#if 0
-        glDeleteVertexArrays(1, &VAO);
-        glDeleteBuffers(1, VBO);
-        glDeleteBuffers(1, EBO);
-#endif
+    // level 0 is the base mesh
+    mesh_range const & lod_range(std::size_t level) const {
+        return level == 0 || lod_ranges.empty() ? range : lod_ranges[std::min(level, lod_ranges.size()) - 1];
     }
 
-    void draw(pwgl::shader & shader) {
+    // resolves the textures of this mesh against the samplers of a shader
+    void bind_material(pwgl::shader const & shader) {
+        material = { };
+        material.program = shader.id;
+        material.position_offset = shader.uniform("position_offset");
+        material.position_scale = shader.uniform("position_scale");
+
         unsigned diffuseNr = 1;
         unsigned specularNr = 1;
         unsigned normalNr = 1;
         unsigned heightNr = 1;
-        for (std::size_t i = 0; i < textures.size(); i++) {
-            glActiveTexture(GL_TEXTURE0 + i);
+        for (auto const & texture : textures) {
             std::string number;
-            std::string name = textures[i].type;
+            std::string const & name = texture.type;
             if (name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if (name == "texture_specular")
                 number = std::to_string(specularNr++);
             else if (name == "texture_normal")
                 number = std::to_string(normalNr++);
-             else if (name == "texture_height")
+            else if (name == "texture_height")
                 number = std::to_string(heightNr++);
 
-            shader.set(i, std::string(name + number));
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            std::string const uniform = name + number;
+            int const unit = shader.texture_unit(uniform);
+            if (unit < 0 || material.count == material.slots.size())
+                continue;   // sampler not used by this program
+            material.slots[material.count++] = { unit, texture.id, shader.uniform(uniform).location };
+        }
+    }
+
+    void bind_textures(pwgl::shader const & shader) {
+        if (material.program != shader.id)
+            bind_material(shader);
+
+        for (std::size_t i = 0; i < material.count; i++) {
+            auto const & slot = material.slots[i];
+            pwgl::gl().bind_texture(static_cast<unsigned>(slot.unit), slot.texture);
         }
+    }
+
+    // binds the textures and per mesh uniforms for a draw of this mesh
+    void bind(pwgl::shader & shader) {
+        bind_textures(shader);
+
+        // dequantization of packed positions, inactive for full vertices
+        if (material.position_scale.location >= 0) {
+            shader.set(material.position_offset, range.position_offset);
+            shader.set(material.position_scale, range.position_scale);
+        }
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    // instances: number of instances streamed by vertex_arena::begin_instances(), 0 for a plain draw
+    void draw(pwgl::shader & shader, std::size_t instances = 0) {
+        bind(shader);
 
-        glActiveTexture(GL_TEXTURE0);
+        // draw mesh, the owning model has bound the arena VAO
+        if (instances)
+            vertex_arena::draw(range, instances);
+        else
+            vertex_arena::draw(range);
     }
 
     // render data
@@ -106,7 +123,14 @@ public:
     std::vector<vertex> vertices;
     std::vector<unsigned> indices;
     std::vector<texture> textures;
-    unsigned VAO;
+    bounding_volume bounds;
+    meshlet_data meshlets;
+    material_binding material;
+    mesh_range range;
+    std::uint32_t node { };                 // in pwgl::model::nodes
+    std::vector<mesh_range> lod_ranges;     // coarser levels, finest first
+    std::vector<float> lod_errors;          // per level including the base mesh (0), in mesh units
+    std::vector<std::uint8_t> instance_lods; // per instance id: level of its last queued draw, see select_lod()
 };
 
 } // pwgl ns
@@ -0,0 +1,279 @@
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include "mesh_data.hpp"
+
+#include "fmt/format.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Binary cache of imported (post processed) mesh data, so that loading a
+// model does not need to run the Assimp importer again.
+//
+// layout (native endianness):
+//   header
+//   per mesh: u32 vertices, u32 indices, u32 textures, bounding_volume,
+//             vertex[vertices], u32[indices],
+//             per texture: u32 len, type, u32 len, path,
+//             u32 meshlets, u32 meshlet vertices, u32 meshlet triangles,
+//             meshlet[meshlets], meshlet_bounds[meshlets],
+//             u32[meshlet vertices], u8[meshlet triangles * 3],
+//             u32 lods, per lod: f32 error, u32 indices, u32[indices],
+//             u32 node
+//   u32 nodes, per node: u32 parent, f32[3] translation, f32[4] rotation
+//             (w x y z), f32[3] scale, u32 len, name
+
+namespace pwgl::mesh_cache {
+
+inline constexpr std::uint32_t magic = 0x434d5750; // "PWMC"
+inline constexpr std::uint32_t version = 6;   // 2: vertex cache optimized meshes, 3: bounds, 4: meshlets, 5: lods, 6: nodes
+
+struct header {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t vertex_size;
+    std::uint32_t mesh_count;
+    std::uint64_t key;
+};
+
+inline std::string cache_path(std::string const & source) {
+    return source + ".pwglbin";
+}
+
+// FNV-1a over source path, modification time and post processing flags
+inline std::uint64_t cache_key(std::string const & source, unsigned flags) {
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](void const * data, std::size_t size) {
+        auto const * p = static_cast<unsigned char const *>(data);
+        for (std::size_t i = 0; i < size; ++i) {
+            hash ^= p[i];
+            hash *= 0x100000001b3ull;
+        }
+    };
+
+    std::error_code ec;
+    auto const mtime = std::filesystem::last_write_time(source, ec).time_since_epoch().count();
+    mix(source.data(), source.size());
+    mix(&mtime, sizeof(mtime));
+    mix(&flags, sizeof(flags));
+    return hash;
+}
+
+// read only memory mapping of a whole file
+struct mapped_file {
+    mapped_file(std::string const & path) {
+        int const fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st { };
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void * p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = static_cast<unsigned char const *>(p);
+                size = static_cast<std::size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+    }
+    ~mapped_file() {
+        if (data)
+            ::munmap(const_cast<unsigned char *>(data), size);
+    }
+    mapped_file(mapped_file const &) = delete;
+    mapped_file & operator=(mapped_file const &) = delete;
+
+    unsigned char const * data { };
+    std::size_t size { };
+};
+
+inline bool store(std::string const & cache_file, std::uint64_t key, std::vector<mesh_data> const & meshes,
+                  std::span<node_data const> nodes = { }) {
+    std::ofstream out(cache_file, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        fmt::print("[-] could not write mesh cache: {}\n", cache_file);
+        return false;
+    }
+
+    auto write = [&out](void const * data, std::size_t size) {
+        out.write(static_cast<char const *>(data), static_cast<std::streamsize>(size));
+    };
+    auto write_u32 = [&write](std::size_t v) {
+        auto const u = static_cast<std::uint32_t>(v);
+        write(&u, sizeof(u));
+    };
+
+    header const hdr { magic, version, sizeof(vertex), static_cast<std::uint32_t>(meshes.size()), key };
+    write(&hdr, sizeof(hdr));
+    for (auto const & m : meshes) {
+        write_u32(m.vertices.size());
+        write_u32(m.indices.size());
+        write_u32(m.textures.size());
+        write(&m.bounds, sizeof(m.bounds));
+        write(m.vertices.data(), m.vertices.size() * sizeof(vertex));
+        write(m.indices.data(), m.indices.size() * sizeof(unsigned));
+        for (auto const & t : m.textures) {
+            write_u32(t.type.size());
+            write(t.type.data(), t.type.size());
+            write_u32(t.path.size());
+            write(t.path.data(), t.path.size());
+        }
+        auto const & ml = m.meshlets;
+        write_u32(ml.meshlets.size());
+        write_u32(ml.vertices.size());
+        write_u32(ml.triangles.size() / 3);
+        write(ml.meshlets.data(), ml.meshlets.size() * sizeof(meshlet));
+        write(ml.bounds.data(), ml.bounds.size() * sizeof(meshlet_bounds));
+        write(ml.vertices.data(), ml.vertices.size() * sizeof(unsigned));
+        write(ml.triangles.data(), ml.triangles.size());
+        write_u32(m.lods.size());
+        for (auto const & lod : m.lods) {
+            write(&lod.error, sizeof(lod.error));
+            write_u32(lod.indices.size());
+            write(lod.indices.data(), lod.indices.size() * sizeof(unsigned));
+        }
+        write_u32(m.node);
+    }
+    write_u32(nodes.size());
+    for (auto const & n : nodes) {
+        float const rotation[4] { n.rotation.w, n.rotation.x, n.rotation.y, n.rotation.z };
+        write_u32(n.parent);
+        write(&n.translation, sizeof(n.translation));
+        write(rotation, sizeof(rotation));
+        write(&n.scale, sizeof(n.scale));
+        write_u32(n.name.size());
+        write(n.name.data(), n.name.size());
+    }
+    return static_cast<bool>(out);
+}
+
+// returns nothing if the cache is missing, stale or malformed. nodes:
+// receives the stored node hierarchy.
+inline std::optional<std::vector<mesh_data>> load(std::string const & cache_file, std::uint64_t key,
+                                                  std::vector<node_data> * nodes = nullptr) {
+    mapped_file file(cache_file);
+    if (!file.data || file.size < sizeof(header))
+        return std::nullopt;
+
+    header hdr;
+    std::memcpy(&hdr, file.data, sizeof(hdr));
+    if (hdr.magic != magic || hdr.version != version || hdr.vertex_size != sizeof(vertex) || hdr.key != key)
+        return std::nullopt;
+    if (hdr.mesh_count > file.size / (3 * sizeof(std::uint32_t)))
+        return std::nullopt;
+
+    std::size_t pos = sizeof(hdr);
+    auto read = [&file, &pos](void * dst, std::size_t size) {
+        if (size > file.size - pos)
+            return false;
+        std::memcpy(dst, file.data + pos, size);
+        pos += size;
+        return true;
+    };
+    auto read_u32 = [&read](std::uint32_t & v) {
+        return read(&v, sizeof(v));
+    };
+    auto read_string = [&](std::string & s) {
+        std::uint32_t len = 0;
+        if (!read_u32(len) || len > file.size - pos)
+            return false;
+        s.assign(reinterpret_cast<char const *>(file.data + pos), len);
+        pos += len;
+        return true;
+    };
+
+    std::vector<mesh_data> meshes(hdr.mesh_count);
+    for (auto & m : meshes) {
+        std::uint32_t nvertices = 0;
+        std::uint32_t nindices = 0;
+        std::uint32_t ntextures = 0;
+        if (!read_u32(nvertices) || !read_u32(nindices) || !read_u32(ntextures) || !read(&m.bounds, sizeof(m.bounds)))
+            return std::nullopt;
+        if (std::size_t(nvertices) * sizeof(vertex) + std::size_t(nindices) * sizeof(unsigned) > file.size - pos)
+            return std::nullopt;
+        m.vertices.resize(nvertices);
+        m.indices.resize(nindices);
+        if (!read(m.vertices.data(), m.vertices.size() * sizeof(vertex))
+         || !read(m.indices.data(), m.indices.size() * sizeof(unsigned)))
+            return std::nullopt;
+        m.textures.resize(ntextures);
+        for (auto & t : m.textures) {
+            t.id = 0;
+            if (!read_string(t.type) || !read_string(t.path))
+                return std::nullopt;
+        }
+
+        auto & ml = m.meshlets;
+        std::uint32_t nmeshlets = 0;
+        std::uint32_t nmeshlet_vertices = 0;
+        std::uint32_t nmeshlet_triangles = 0;
+        if (!read_u32(nmeshlets) || !read_u32(nmeshlet_vertices) || !read_u32(nmeshlet_triangles))
+            return std::nullopt;
+        if (std::size_t(nmeshlets) * (sizeof(meshlet) + sizeof(meshlet_bounds)) + std::size_t(nmeshlet_vertices) * sizeof(unsigned)
+          + std::size_t(nmeshlet_triangles) * 3 > file.size - pos)
+            return std::nullopt;
+        ml.meshlets.resize(nmeshlets);
+        ml.bounds.resize(nmeshlets);
+        ml.vertices.resize(nmeshlet_vertices);
+        ml.triangles.resize(std::size_t(nmeshlet_triangles) * 3);
+        if (!read(ml.meshlets.data(), ml.meshlets.size() * sizeof(meshlet))
+         || !read(ml.bounds.data(), ml.bounds.size() * sizeof(meshlet_bounds))
+         || !read(ml.vertices.data(), ml.vertices.size() * sizeof(unsigned))
+         || !read(ml.triangles.data(), ml.triangles.size()))
+            return std::nullopt;
+
+        std::uint32_t nlods = 0;
+        if (!read_u32(nlods) || nlods > (file.size - pos) / (2 * sizeof(std::uint32_t)))
+            return std::nullopt;
+        m.lods.resize(nlods);
+        for (auto & lod : m.lods) {
+            std::uint32_t nlod_indices = 0;
+            if (!read(&lod.error, sizeof(lod.error)) || !read_u32(nlod_indices)
+             || std::size_t(nlod_indices) * sizeof(unsigned) > file.size - pos)
+                return std::nullopt;
+            lod.indices.resize(nlod_indices);
+            if (!read(lod.indices.data(), lod.indices.size() * sizeof(unsigned)))
+                return std::nullopt;
+        }
+        if (!read_u32(m.node))
+            return std::nullopt;
+    }
+
+    std::uint32_t nnodes = 0;
+    if (!read_u32(nnodes) || nnodes > (file.size - pos) / (12 * sizeof(std::uint32_t)))
+        return std::nullopt;
+    std::vector<node_data> hierarchy(nnodes);
+    for (std::size_t i = 0; i < hierarchy.size(); ++i) {
+        auto & n = hierarchy[i];
+        float rotation[4];
+        if (!read_u32(n.parent) || !read(&n.translation, sizeof(n.translation)) || !read(rotation, sizeof(rotation))
+         || !read(&n.scale, sizeof(n.scale)) || !read_string(n.name))
+            return std::nullopt;
+        // parents first, as scene_graph expects
+        if (n.parent != no_node && n.parent >= i)
+            return std::nullopt;
+        n.rotation = glm::quat(rotation[0], rotation[1], rotation[2], rotation[3]);
+    }
+    for (auto const & m : meshes) {
+        if (m.node >= std::max<std::size_t>(hierarchy.size(), 1))
+            return std::nullopt;
+    }
+    if (nodes)
+        *nodes = std::move(hierarchy);
+    return meshes;
+}
+
+} // pwgl::mesh_cache ns
+#endif
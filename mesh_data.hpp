@@ -0,0 +1,136 @@
+#ifndef MESH_DATA_HPP
+#define MESH_DATA_HPP
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU side mesh representation, free of any GL calls so it can be produced
+// and consumed by headless tools (baking, optimization, statistics).
+
+namespace pwgl {
+
+struct vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+};
+
+struct texture {
+    unsigned int id;
+    std::string type;
+    std::string path;
+};
+
+// axis aligned box and enclosing sphere in mesh space
+struct bounding_volume {
+    glm::vec3 min { 0.0f };
+    glm::vec3 max { 0.0f };
+    glm::vec3 center { 0.0f };
+    float radius { };
+};
+
+inline bounding_volume compute_bounds(std::vector<vertex> const & vertices) {
+    bounding_volume bv;
+    if (vertices.empty())
+        return bv;
+
+    bv.min = bv.max = vertices.front().Position;
+    for (auto const & v : vertices) {
+        bv.min = glm::min(bv.min, v.Position);
+        bv.max = glm::max(bv.max, v.Position);
+    }
+    bv.center = (bv.min + bv.max) * 0.5f;
+    for (auto const & v : vertices)
+        bv.radius = std::max(bv.radius, glm::distance(bv.center, v.Position));
+    return bv;
+}
+
+// bv after the affine transform m: the box around the transformed box, the
+// sphere scaled by the largest axis scale
+inline bounding_volume transform_bounds(bounding_volume const & bv, glm::mat4 const & m) {
+    glm::vec3 const x(m[0]), y(m[1]), z(m[2]);
+    glm::vec3 const c(m * glm::vec4((bv.min + bv.max) * 0.5f, 1.0f));
+    glm::vec3 const e = (bv.max - bv.min) * 0.5f;
+    glm::vec3 const extent = glm::abs(x) * e.x + glm::abs(y) * e.y + glm::abs(z) * e.z;
+
+    bounding_volume out;
+    out.min = c - extent;
+    out.max = c + extent;
+    out.center = glm::vec3(m * glm::vec4(bv.center, 1.0f));
+    out.radius = bv.radius * std::sqrt(std::max({ glm::dot(x, x), glm::dot(y, y), glm::dot(z, z) }));
+    return out;
+}
+
+// cluster of at most meshlet_max_vertices / meshlet_max_triangles: its
+// vertices are meshlet_data::vertices[vertex_offset ..] (indices into the
+// mesh), its triangles meshlet_data::triangles[triangle_offset * 3 ..]
+// (indices into its vertices)
+struct meshlet {
+    std::uint32_t vertex_offset;
+    std::uint32_t triangle_offset;
+    std::uint32_t vertex_count;
+    std::uint32_t triangle_count;
+};
+
+// bounding sphere and normal cone of a meshlet in mesh space. the cluster
+// is back facing for a viewer when
+//   dot(center - viewer, cone_axis) >= cone_cutoff * |center - viewer| + radius
+// cone_cutoff 1 never is.
+struct meshlet_bounds {
+    glm::vec3 center { 0.0f };
+    float radius { };
+    glm::vec3 cone_axis { 0.0f };
+    float cone_cutoff { 1.0f };
+};
+
+// meshlets of one mesh, see meshlet.hpp
+struct meshlet_data {
+    std::vector<meshlet> meshlets;
+    std::vector<meshlet_bounds> bounds;
+    std::vector<unsigned> vertices;
+    std::vector<std::uint8_t> triangles;
+};
+
+// coarser level of a mesh (mesh_simplifier.hpp): indices into the base
+// vertices and the largest geometric deviation from the base mesh, in mesh
+// units
+struct mesh_lod {
+    std::vector<unsigned> indices;
+    float error { };
+};
+
+inline constexpr std::uint32_t no_node = ~std::uint32_t(0);
+
+// node of the imported hierarchy (scene_graph.hpp), its transform relative
+// to the parent. the nodes of an import are in depth first order, parents
+// before their children.
+struct node_data {
+    std::string name;
+    std::uint32_t parent { no_node };
+    glm::vec3 translation { 0.0f };
+    glm::quat rotation { 1.0f, 0.0f, 0.0f, 0.0f };
+    glm::vec3 scale { 1.0f };
+};
+
+// output of the import stage: texture ids are unresolved (0) until the
+// textures are uploaded by pwgl::model
+struct mesh_data {
+    std::vector<vertex> vertices;
+    std::vector<unsigned> indices;
+    std::vector<texture> textures;
+    bounding_volume bounds;
+    meshlet_data meshlets;      // built from the final index order, stale after reordering
+    std::vector<mesh_lod> lods; // finest first, not counting the base mesh
+    std::uint32_t node { };     // the node_data placing the mesh, 0 the root
+};
+
+} // pwgl ns
+#endif
@@ -0,0 +1,294 @@
+#ifndef MESH_OPTIMIZER_HPP
+#define MESH_OPTIMIZER_HPP
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+// Import time index/vertex reordering, GL free:
+//   1. vertex cache: Tipsify (Sander, Nehab, Barczak 2007)
+//   2. overdraw (optional): splits the Tipsify output into clusters where
+//      their running ACMR drops below a threshold, and sorts those front
+//      to back relative to the mesh center (fast approximate variant)
+//   3. vertex fetch: vertices renumbered in order of first use
+
+namespace pwgl {
+
+// post transform cache simulation over a FIFO of cache_size entries
+struct vertex_cache_stats {
+    std::size_t misses { };
+    double acmr { };    // average cache miss ratio, transformed vertices per triangle
+    double atvr { };    // average transform to vertex ratio, 1.0 is optimal
+};
+
+inline vertex_cache_stats analyze_vertex_cache(std::vector<unsigned> const & indices, std::size_t vertex_count, std::size_t cache_size = 16) {
+    vertex_cache_stats stats;
+    if (indices.empty())
+        return stats;
+
+    // a vertex is in the fifo if it was inserted less than cache_size misses ago
+    std::vector<std::size_t> inserted(vertex_count, 0);
+    std::vector<bool> used(vertex_count, false);
+    std::size_t unique = 0;
+    for (unsigned v : indices) {
+        if (!used[v]) {
+            used[v] = true;
+            ++unique;
+        }
+        if (inserted[v] == 0 || stats.misses + 1 - inserted[v] > cache_size) {
+            ++stats.misses;
+            inserted[v] = stats.misses;
+        }
+    }
+    stats.acmr = double(stats.misses) / double(indices.size() / 3);
+    stats.atvr = double(stats.misses) / double(unique);
+    return stats;
+}
+
+namespace detail {
+
+// vertex -> triangles adjacency in compressed row form
+struct triangle_adjacency {
+    triangle_adjacency(std::vector<unsigned> const & indices, std::size_t vertex_count)
+        : offsets(vertex_count + 1, 0)
+        , triangles(indices.size())
+    {
+        for (unsigned v : indices)
+            ++offsets[v + 1];
+        std::partial_sum(std::begin(offsets), std::end(offsets), std::begin(offsets));
+        std::vector<std::size_t> fill(std::begin(offsets), std::end(offsets) - 1);
+        for (std::size_t i = 0; i < indices.size(); ++i)
+            triangles[fill[indices[i]]++] = static_cast<unsigned>(i / 3);
+    }
+
+    std::size_t count(unsigned v) const {
+        return offsets[v + 1] - offsets[v];
+    }
+
+    std::vector<std::size_t> offsets;
+    std::vector<unsigned> triangles;
+};
+
+} // detail ns
+
+// reorders the triangles for the post transform cache, returns the first
+// triangle of every cluster (a cluster ends when Tipsify has to restart
+// from an unconnected part of the mesh)
+inline std::vector<std::size_t> optimize_vertex_cache(std::vector<unsigned> & indices, std::size_t vertex_count, std::size_t cache_size = 16) {
+    std::size_t const triangle_count = indices.size() / 3;
+    std::vector<std::size_t> clusters;
+    if (triangle_count == 0)
+        return clusters;
+
+    detail::triangle_adjacency const adjacency(indices, vertex_count);
+    std::vector<std::size_t> live(vertex_count);
+    for (unsigned v = 0; v < vertex_count; ++v)
+        live[v] = adjacency.count(v);
+
+    std::vector<std::size_t> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<unsigned> dead_end;
+    std::vector<unsigned> candidates;
+    std::vector<unsigned> output;
+    output.reserve(indices.size());
+
+    std::size_t time = cache_size + 1;
+    std::size_t cursor = 0;
+
+    auto skip_dead_end = [&](bool & scanned) -> long {
+        while (!dead_end.empty()) {
+            unsigned const d = dead_end.back();
+            dead_end.pop_back();
+            if (live[d] > 0)
+                return d;
+        }
+        scanned = true;
+        for (; cursor < vertex_count; ++cursor) {
+            if (live[cursor] > 0)
+                return static_cast<long>(cursor);
+        }
+        return -1;
+    };
+
+    bool scanned = false;
+    long fanning = skip_dead_end(scanned);
+    while (fanning >= 0) {
+        if (scanned) {
+            clusters.push_back(output.size() / 3);
+            scanned = false;
+        }
+
+        candidates.clear();
+        auto const f = static_cast<unsigned>(fanning);
+        for (std::size_t a = adjacency.offsets[f]; a < adjacency.offsets[f + 1]; ++a) {
+            unsigned const t = adjacency.triangles[a];
+            if (emitted[t])
+                continue;
+            for (std::size_t k = 0; k < 3; ++k) {
+                unsigned const v = indices[t * 3 + k];
+                output.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cache_time[v] > cache_size)
+                    cache_time[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // next fanning vertex: the candidate that stays longest in the cache
+        // and will still be in it after emitting all of its triangles
+        long best = -1;
+        std::size_t best_priority = 0;
+        for (unsigned v : candidates) {
+            if (live[v] == 0)
+                continue;
+            std::size_t priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cache_size)
+                priority = time - cache_time[v];
+            if (best < 0 || priority > best_priority) {
+                best = v;
+                best_priority = priority;
+            }
+        }
+        fanning = best >= 0 ? best : skip_dead_end(scanned);
+    }
+
+    indices = std::move(output);
+    return clusters;
+}
+
+// first triangles of the clusters of a vertex cache optimized index list:
+// every boundary (the restarts of optimize_vertex_cache()) begins one, and
+// a cluster ends as soon as its ACMR, simulated from a cold cache, drops
+// below threshold (Sander et al. 2007, section 4.1). reordering the
+// clusters then costs about threshold misses per triangle.
+inline std::vector<std::size_t> split_clusters(std::vector<unsigned> const & indices, std::size_t vertex_count,
+                                               std::vector<std::size_t> const & boundaries, float threshold = 0.75f,
+                                               std::size_t cache_size = 16) {
+    std::size_t const triangle_count = indices.size() / 3;
+    std::vector<std::size_t> clusters;
+    std::vector<std::size_t> cache_time(vertex_count, 0);
+    std::size_t time = cache_size + 1;
+    std::size_t next = 0;       // in boundaries
+    std::size_t first = 0;      // of the current cluster
+    std::size_t misses = 0;     // of the current cluster
+    bool closed = true;
+    for (std::size_t t = 0; t < triangle_count; ++t) {
+        for (; next < boundaries.size() && boundaries[next] <= t; ++next)
+            closed = true;
+        if (closed) {
+            clusters.push_back(t);
+            first = t;
+            misses = 0;
+            time += cache_size + 1;     // every entry stale, a cold cache
+            closed = false;
+        }
+        for (std::size_t k = 0; k < 3; ++k) {
+            unsigned const v = indices[t * 3 + k];
+            if (time - cache_time[v] > cache_size) {
+                cache_time[v] = time++;
+                ++misses;
+            }
+        }
+        closed = float(misses) < threshold * float(t - first + 1);
+    }
+    return clusters;
+}
+
+// splits the vertex cache optimized triangles into clusters at boundaries
+// and where split_clusters() ends them, then sorts the clusters so that
+// outward facing ones, which are likely to occlude the rest of the mesh,
+// are drawn first. returns the number of clusters.
+inline std::size_t optimize_overdraw(std::vector<unsigned> & indices, std::vector<vertex> const & vertices,
+                                     std::vector<std::size_t> const & boundaries, float threshold = 0.75f,
+                                     std::size_t cache_size = 16) {
+    std::size_t const triangle_count = indices.size() / 3;
+    auto const clusters = split_clusters(indices, vertices.size(), boundaries, threshold, cache_size);
+    if (clusters.size() < 2)
+        return clusters.size();
+
+    glm::vec3 center { 0.0f };
+    for (auto const & v : vertices)
+        center += v.Position;
+    center /= float(vertices.size());
+
+    struct cluster_order {
+        std::size_t first;
+        std::size_t last;
+        float key;
+    };
+    std::vector<cluster_order> order;
+    for (std::size_t c = 0; c < clusters.size(); ++c) {
+        std::size_t const first = clusters[c];
+        std::size_t const last = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+
+        glm::vec3 centroid { 0.0f };
+        glm::vec3 normal { 0.0f };
+        float area = 0.0f;
+        for (std::size_t t = first; t < last; ++t) {
+            glm::vec3 const & a = vertices[indices[t * 3 + 0]].Position;
+            glm::vec3 const & b = vertices[indices[t * 3 + 1]].Position;
+            glm::vec3 const & c2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 const n = glm::cross(b - a, c2 - a);  // length is twice the area
+            float const w = glm::length(n);
+            centroid += (a + b + c2) * (w / 3.0f);
+            normal += n;
+            area += w;
+        }
+        if (area > 0.0f)
+            centroid /= area;
+        order.push_back({ first, last, glm::dot(centroid - center, normal) / std::max(area, 1e-20f) });
+    }
+
+    std::stable_sort(std::begin(order), std::end(order), [](auto const & a, auto const & b) {
+        return a.key > b.key;
+    });
+
+    std::vector<unsigned> output;
+    output.reserve(indices.size());
+    for (auto const & c : order)
+        output.insert(std::end(output), std::begin(indices) + long(c.first * 3), std::begin(indices) + long(c.last * 3));
+    indices = std::move(output);
+    return clusters.size();
+}
+
+// renumbers the vertices in order of first use, so vertex fetches become
+// mostly sequential. unreferenced vertices are moved to the end.
+inline void optimize_vertex_fetch(mesh_data & mesh) {
+    constexpr unsigned unused = ~0u;
+    std::vector<unsigned> remap(mesh.vertices.size(), unused);
+    std::vector<vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+
+    for (auto & index : mesh.indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<unsigned>(vertices.size());
+            vertices.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    for (std::size_t v = 0; v < mesh.vertices.size(); ++v) {
+        if (remap[v] == unused)
+            vertices.push_back(mesh.vertices[v]);
+    }
+    mesh.vertices = std::move(vertices);
+}
+
+// returns the number of clusters sorted for overdraw, 0 without
+inline std::size_t optimize_mesh(mesh_data & mesh, bool overdraw = false, std::size_t cache_size = 16) {
+    auto const boundaries = optimize_vertex_cache(mesh.indices, mesh.vertices.size(), cache_size);
+    std::size_t clusters = 0;
+    if (overdraw)
+        clusters = optimize_overdraw(mesh.indices, mesh.vertices, boundaries, 0.75f, cache_size);
+    optimize_vertex_fetch(mesh);
+    return clusters;
+}
+
+} // pwgl ns
+#endif
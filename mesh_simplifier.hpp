@@ -0,0 +1,421 @@
+#ifndef MESH_SIMPLIFIER_HPP
+#define MESH_SIMPLIFIER_HPP
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+#include "mesh_optimizer.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+// Edge collapse simplification with quadric error metrics (Garland,
+// Heckbert 1997) and the LOD chain built from it at import, GL free.
+//
+// Collapses are half edge: a vertex moves onto a neighbour, so every level
+// indexes the vertices of the base mesh and only adds an index list. The
+// vertices are classified once by their edges:
+//   manifold  closed fan, may move onto any neighbour
+//   border    on one open edge pair, only along the border
+//   seam      one of two vertices sharing a position with different
+//             attributes (UV or normal seam), only along the seam and
+//             together with its twin, so both sides stay stitched
+//   locked    anything else (corners, more than two wedges, non manifold
+//             fans), never moves
+// Cost of a collapse: the quadric of the moving vertex at the destination,
+// plus a penalty on the normal and texture coordinate change scaled to the
+// mesh size (a cheap stand-in for attribute quadrics). Collapses that flip
+// a triangle are rejected. Every pass takes the cheapest collapses whose
+// vertices were not touched yet in that pass.
+
+namespace pwgl {
+
+namespace detail {
+
+// area weighted squared distance to a set of planes
+struct quadric {
+    double a2 { }, b2 { }, c2 { }, ab { }, ac { }, bc { }, ad { }, bd { }, cd { }, d2 { }, w { };
+
+    // plane dot(n, p) + d = 0, n unit length
+    static quadric plane(glm::vec3 n, float d, float weight) {
+        double const x = n.x, y = n.y, z = n.z, dd = d, ww = weight;
+        return { ww * x * x, ww * y * y, ww * z * z, ww * x * y, ww * x * z, ww * y * z,
+                 ww * x * dd, ww * y * dd, ww * z * dd, ww * dd * dd, ww };
+    }
+
+    quadric & operator+=(quadric const & o) {
+        a2 += o.a2; b2 += o.b2; c2 += o.c2;
+        ab += o.ab; ac += o.ac; bc += o.bc;
+        ad += o.ad; bd += o.bd; cd += o.cd;
+        d2 += o.d2; w += o.w;
+        return *this;
+    }
+
+    // mean squared distance of p to the planes
+    double error(glm::vec3 p) const {
+        double const x = p.x, y = p.y, z = p.z;
+        double const e = a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z)
+                       + 2.0 * (ad * x + bd * y + cd * z) + d2;
+        return w > 0.0 ? std::fabs(e) / w : 0.0;
+    }
+};
+
+enum class vertex_kind : std::uint8_t {
+    manifold,
+    border,
+    seam,
+    locked,
+};
+
+inline constexpr unsigned no_vertex = ~0u;
+
+struct simplify_topology {
+    std::vector<unsigned> remap;        // first vertex with the same position
+    std::vector<unsigned> wedge;        // next vertex with the same position, circular
+    std::vector<vertex_kind> kind;
+    std::vector<unsigned> open_out;     // border / seam: the neighbours along the open edges
+    std::vector<unsigned> open_in;
+    std::vector<std::uint64_t> position_edges;  // sorted directed edges between remap[] vertices
+};
+
+inline std::uint64_t edge_key(unsigned a, unsigned b) {
+    return std::uint64_t(a) << 32 | b;
+}
+
+inline bool has_edge(std::vector<std::uint64_t> const & edges, unsigned a, unsigned b) {
+    return std::binary_search(std::begin(edges), std::end(edges), edge_key(a, b));
+}
+
+inline simplify_topology classify(std::vector<vertex> const & vertices, std::vector<unsigned> const & indices) {
+    std::size_t const count = vertices.size();
+    simplify_topology t;
+
+    // position groups: equal position bits
+    auto bits = [&](unsigned v) {
+        auto const & p = vertices[v].Position;
+        return std::tuple(std::bit_cast<std::uint32_t>(p.x), std::bit_cast<std::uint32_t>(p.y), std::bit_cast<std::uint32_t>(p.z));
+    };
+    std::vector<unsigned> order(count);
+    std::iota(std::begin(order), std::end(order), 0u);
+    std::sort(std::begin(order), std::end(order), [&](unsigned a, unsigned b) {
+        return std::tuple(bits(a), a) < std::tuple(bits(b), b);
+    });
+    t.remap.resize(count);
+    t.wedge.resize(count);
+    for (std::size_t begin = 0; begin < count;) {
+        std::size_t end = begin + 1;
+        while (end < count && bits(order[end]) == bits(order[begin]))
+            ++end;
+        for (std::size_t i = begin; i < end; ++i) {
+            t.remap[order[i]] = order[begin];
+            t.wedge[order[i]] = order[i + 1 < end ? i + 1 : begin];
+        }
+        begin = end;
+    }
+
+    std::vector<std::uint64_t> edges;
+    edges.reserve(indices.size());
+    t.position_edges.reserve(indices.size());
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        for (std::size_t k = 0; k < 3; ++k) {
+            unsigned const a = indices[i + k];
+            unsigned const b = indices[i + (k + 1) % 3];
+            edges.push_back(edge_key(a, b));
+            t.position_edges.push_back(edge_key(t.remap[a], t.remap[b]));
+        }
+    }
+    std::sort(std::begin(edges), std::end(edges));
+    std::sort(std::begin(t.position_edges), std::end(t.position_edges));
+
+    // open edges have no reverse twin between the same vertices
+    std::vector<std::uint8_t> outs(count, 0);
+    std::vector<std::uint8_t> ins(count, 0);
+    t.open_out.assign(count, no_vertex);
+    t.open_in.assign(count, no_vertex);
+    for (std::uint64_t e : edges) {
+        auto const a = static_cast<unsigned>(e >> 32);
+        auto const b = static_cast<unsigned>(e & 0xffffffffu);
+        if (has_edge(edges, b, a))
+            continue;
+        outs[a] = static_cast<std::uint8_t>(std::min(outs[a] + 1, 2));
+        ins[b] = static_cast<std::uint8_t>(std::min(ins[b] + 1, 2));
+        t.open_out[a] = b;
+        t.open_in[b] = a;
+    }
+
+    t.kind.assign(count, vertex_kind::locked);
+    for (unsigned v = 0; v < count; ++v) {
+        std::size_t wedges = 1;
+        for (unsigned w = t.wedge[v]; w != v && wedges < 3; w = t.wedge[w])
+            ++wedges;
+        bool const open = outs[v] == 1 && ins[v] == 1;
+        if (wedges == 1 && outs[v] == 0 && ins[v] == 0) {
+            t.kind[v] = vertex_kind::manifold;
+        } else if (wedges == 1 && open) {
+            t.kind[v] = vertex_kind::border;
+        } else if (wedges == 2 && open) {
+            // the other side of the seam closes the open edges
+            bool const closed = has_edge(t.position_edges, t.remap[t.open_out[v]], t.remap[v])
+                             && has_edge(t.position_edges, t.remap[v], t.remap[t.open_in[v]]);
+            if (closed)
+                t.kind[v] = vertex_kind::seam;
+        }
+    }
+    for (unsigned v = 0; v < count; ++v) {
+        if (t.kind[v] == vertex_kind::seam && t.kind[t.wedge[v]] != vertex_kind::seam)
+            t.kind[v] = vertex_kind::locked;
+    }
+    return t;
+}
+
+struct collapse {
+    unsigned from;
+    unsigned to;
+    unsigned twin_from;     // seam: the other side, no_vertex otherwise
+    unsigned twin_to;
+    double cost;
+    double error;           // geometric part of cost
+};
+
+} // detail ns
+
+// simplifies indices towards target_index_count, stopping early when no
+// collapse below max_error (mesh units) is left. returns the new index
+// list; error receives the largest deviation of a collapse.
+// attribute_weight: normal/texture coordinate penalty relative to the
+// squared mesh extent.
+inline std::vector<unsigned> simplify_mesh(std::vector<vertex> const & vertices, std::vector<unsigned> const & indices,
+                                           std::size_t target_index_count, float max_error = std::numeric_limits<float>::max(),
+                                           float * error = nullptr, float attribute_weight = 0.01f) {
+    using namespace detail;
+    std::size_t const count = vertices.size();
+    std::vector<unsigned> result = indices;
+    if (error)
+        *error = 0.0f;
+    if (indices.size() <= target_index_count || count == 0)
+        return result;
+
+    auto const topology = classify(vertices, indices);
+    auto const & remap = topology.remap;
+    auto position = [&](unsigned v) -> glm::vec3 const & { return vertices[v].Position; };
+
+    // plane quadrics of the triangles, and of planes through the open
+    // edges perpendicular to their triangle so borders keep their shape
+    std::vector<quadric> quadrics(count);
+    glm::vec3 lo = position(indices[0]);
+    glm::vec3 hi = lo;
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        unsigned const c[3] = { indices[i], indices[i + 1], indices[i + 2] };
+        glm::vec3 n = glm::cross(position(c[1]) - position(c[0]), position(c[2]) - position(c[0]));
+        float const area2 = glm::length(n);
+        for (unsigned v : c) {
+            lo = glm::min(lo, position(v));
+            hi = glm::max(hi, position(v));
+        }
+        if (area2 <= 0.0f)
+            continue;
+        n /= area2;
+        auto const q = quadric::plane(n, -glm::dot(n, position(c[0])), area2 * 0.5f);
+        for (unsigned v : c)
+            quadrics[remap[v]] += q;
+
+        for (std::size_t k = 0; k < 3; ++k) {
+            unsigned const a = remap[c[k]];
+            unsigned const b = remap[c[(k + 1) % 3]];
+            if (has_edge(topology.position_edges, b, a))
+                continue;
+            glm::vec3 const edge = position(b) - position(a);
+            glm::vec3 const side = glm::cross(edge, n);
+            float const length = glm::length(side);
+            if (length <= 0.0f)
+                continue;
+            auto const border = quadric::plane(side / length, -glm::dot(side / length, position(a)), 2.0f * glm::dot(edge, edge));
+            quadrics[a] += border;
+            quadrics[b] += border;
+        }
+    }
+    glm::vec3 const diagonal = hi - lo;
+    double const attribute_scale = double(attribute_weight) * double(glm::dot(diagonal, diagonal));
+    double const error_limit = double(max_error) * double(max_error);
+
+    auto attribute_cost = [&](unsigned a, unsigned b) {
+        glm::vec3 const n = vertices[a].Normal - vertices[b].Normal;
+        glm::vec2 const uv = vertices[a].TexCoords - vertices[b].TexCoords;
+        return attribute_scale * double(0.25f * glm::dot(n, n) + glm::dot(uv, uv));
+    };
+
+    // the vertex at to's position on from's twin side of a seam
+    auto twin_target = [&](unsigned twin, unsigned to) {
+        for (unsigned n : { topology.open_out[twin], topology.open_in[twin] }) {
+            if (n != no_vertex && remap[n] == remap[to])
+                return n;
+        }
+        return no_vertex;
+    };
+
+    auto candidate = [&](unsigned from, unsigned to, collapse & c) {
+        auto const kind = topology.kind[from];
+        if (kind == vertex_kind::locked || remap[from] == remap[to])
+            return false;
+        c = { from, to, no_vertex, no_vertex, 0.0, 0.0 };
+        if (kind == vertex_kind::border || kind == vertex_kind::seam) {
+            auto const to_kind = topology.kind[to];
+            if (to_kind == vertex_kind::manifold || (to_kind != vertex_kind::locked && to_kind != kind))
+                return false;
+            if (topology.open_out[from] != to && topology.open_in[from] != to)
+                return false;
+        }
+        if (kind == vertex_kind::seam) {
+            c.twin_from = topology.wedge[from];
+            c.twin_to = twin_target(c.twin_from, to);
+            if (c.twin_to == no_vertex)
+                return false;
+        }
+        c.error = quadrics[remap[from]].error(position(to));
+        c.cost = c.error + attribute_cost(from, to);
+        if (c.twin_from != no_vertex)
+            c.cost += attribute_cost(c.twin_from, c.twin_to);
+        return true;
+    };
+
+    std::vector<unsigned> target(count);
+    std::vector<bool> touched(count);
+    std::vector<collapse> collapses;
+    double worst = 0.0;
+    std::size_t const target_triangles = target_index_count / 3;
+
+    while (result.size() / 3 > target_triangles) {
+        triangle_adjacency const adjacency(result, count);
+
+        collapses.clear();
+        for (std::size_t i = 0; i + 2 < result.size(); i += 3) {
+            for (std::size_t k = 0; k < 3; ++k) {
+                unsigned const a = result[i + k];
+                unsigned const b = result[i + (k + 1) % 3];
+                collapse c;
+                if (candidate(a, b, c) && c.cost <= error_limit)
+                    collapses.push_back(c);
+                if (candidate(b, a, c) && c.cost <= error_limit)
+                    collapses.push_back(c);
+            }
+        }
+        if (collapses.empty())
+            break;
+        std::sort(std::begin(collapses), std::end(collapses), [](auto const & x, auto const & y) {
+            return x.cost < y.cost;
+        });
+
+        std::iota(std::begin(target), std::end(target), 0u);
+        std::fill(std::begin(touched), std::end(touched), false);
+
+        // triangles around from that lose it, false if one of them flips
+        auto moves = [&](unsigned from, unsigned to, std::size_t & removed) {
+            for (std::size_t a = adjacency.offsets[from]; a < adjacency.offsets[from + 1]; ++a) {
+                std::size_t const t = adjacency.triangles[a] * std::size_t(3);
+                unsigned c[3] = { target[result[t]], target[result[t + 1]], target[result[t + 2]] };
+                if (c[0] == to || c[1] == to || c[2] == to) {
+                    ++removed;
+                    continue;
+                }
+                glm::vec3 const before = glm::cross(position(c[1]) - position(c[0]), position(c[2]) - position(c[0]));
+                for (auto & v : c)
+                    v = v == from ? to : v;
+                glm::vec3 const after = glm::cross(position(c[1]) - position(c[0]), position(c[2]) - position(c[0]));
+                if (glm::dot(before, after) <= 0.0f)
+                    return false;
+            }
+            return true;
+        };
+
+        std::size_t const goal = result.size() / 3 - target_triangles;
+        std::size_t removed = 0;
+        std::size_t applied = 0;
+        for (auto const & c : collapses) {
+            if (removed >= goal)
+                break;
+            if (touched[remap[c.from]] || touched[remap[c.to]])
+                continue;
+            std::size_t lost = 0;
+            if (!moves(c.from, c.to, lost))
+                continue;
+            if (c.twin_from != no_vertex && !moves(c.twin_from, c.twin_to, lost))
+                continue;
+
+            target[c.from] = c.to;
+            if (c.twin_from != no_vertex)
+                target[c.twin_from] = c.twin_to;
+            quadrics[remap[c.to]] += quadrics[remap[c.from]];
+            touched[remap[c.from]] = true;
+            touched[remap[c.to]] = true;
+            worst = std::max(worst, c.error);
+            removed += lost;
+            ++applied;
+        }
+        if (!applied)
+            break;
+
+        std::size_t out = 0;
+        for (std::size_t i = 0; i + 2 < result.size(); i += 3) {
+            unsigned const a = target[result[i]];
+            unsigned const b = target[result[i + 1]];
+            unsigned const c = target[result[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+            result[out++] = a;
+            result[out++] = b;
+            result[out++] = c;
+        }
+        result.resize(out);
+    }
+
+    if (error)
+        *error = static_cast<float>(std::sqrt(worst));
+    return result;
+}
+
+// up to levels coarser versions of a mesh, each with about ratio of the
+// triangles of the previous one. stops early when a level would keep more
+// than 90% of them (locked seams and borders). the error of a level is
+// bounded by the sum of the errors of the steps leading to it.
+inline std::vector<mesh_lod> build_lods(std::vector<vertex> const & vertices, std::vector<unsigned> const & indices,
+                                               std::size_t levels = 4, float ratio = 0.5f) {
+    std::vector<mesh_lod> lods;
+    lods.reserve(levels);   // current points into it
+    std::vector<unsigned> const * current = &indices;
+    float error = 0.0f;
+    for (std::size_t level = 0; level < levels; ++level) {
+        std::size_t const triangles = current->size() / 3;
+        auto const target = static_cast<std::size_t>(float(triangles) * ratio);
+        if (target < 8)
+            break;
+
+        float step = 0.0f;
+        auto next = simplify_mesh(vertices, *current, target * 3, std::numeric_limits<float>::max(), &step);
+        if (next.size() / 3 > triangles * 9 / 10)
+            break;
+        optimize_vertex_cache(next, vertices.size());
+        error += step;
+        lods.push_back({ std::move(next), error });
+        current = &lods.back().indices;
+    }
+    return lods;
+}
+
+// import stage: LOD chains of every mesh, meshes in parallel on the pool
+inline void build_lods(std::vector<mesh_data> & meshes) {
+    workers().parallel_for(meshes.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i)
+            meshes[i].lods = build_lods(meshes[i].vertices, meshes[i].indices);
+    });
+}
+
+} // pwgl ns
+#endif
@@ -0,0 +1,234 @@
+#ifndef MESHLET_HPP
+#define MESHLET_HPP
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+#include "mesh_data.hpp"
+#include "mesh_optimizer.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// Partitioning of a mesh into meshlets and the CPU culling pass over them,
+// GL free. The import stage splits every mesh into clusters of at most 64
+// vertices and 124 triangles, each with a bounding sphere and a normal
+// cone. Per frame, clusters outside the frustum or facing away from the
+// viewer are dropped and the triangles of the others are concatenated
+// into the index list drawn for the frame (pwgl::model::draw_clusters).
+//
+// builder: greedy. A meshlet grows by the triangle connected to it that
+//          adds the fewest new vertices, ties go to the one closest to the
+//          meshlet center. Without a connected triangle the next unused one
+//          in index order is taken, which after the vertex cache pass is
+//          usually close by.
+// cones:   axis is the mean triangle normal, a cluster whose normals
+//          spread over more than ~84 degrees from it is never back facing.
+
+namespace pwgl {
+
+inline constexpr std::size_t meshlet_max_vertices = 64;
+inline constexpr std::size_t meshlet_max_triangles = 124;
+
+inline meshlet_bounds compute_meshlet_bounds(meshlet_data const & m, meshlet const & c, std::vector<vertex> const & vertices) {
+    meshlet_bounds b;
+    if (!c.vertex_count)
+        return b;
+
+    for (std::size_t i = 0; i < c.vertex_count; ++i)
+        b.center += vertices[m.vertices[c.vertex_offset + i]].Position;
+    b.center /= float(c.vertex_count);
+    for (std::size_t i = 0; i < c.vertex_count; ++i)
+        b.radius = std::max(b.radius, glm::distance(b.center, vertices[m.vertices[c.vertex_offset + i]].Position));
+
+    auto normal = [&](std::size_t t) {
+        std::size_t const corner = (c.triangle_offset + t) * 3;
+        glm::vec3 const & p0 = vertices[m.vertices[c.vertex_offset + m.triangles[corner + 0]]].Position;
+        glm::vec3 const & p1 = vertices[m.vertices[c.vertex_offset + m.triangles[corner + 1]]].Position;
+        glm::vec3 const & p2 = vertices[m.vertices[c.vertex_offset + m.triangles[corner + 2]]].Position;
+        glm::vec3 const n = glm::cross(p1 - p0, p2 - p0);
+        float const l = glm::length(n);
+        return l > 0.0f ? n / l : glm::vec3(0.0f);
+    };
+
+    glm::vec3 axis { 0.0f };
+    for (std::size_t t = 0; t < c.triangle_count; ++t)
+        axis += normal(t);
+    float const length = glm::length(axis);
+    if (length < 1e-6f)
+        return b;
+    axis /= length;
+
+    float min_dot = 1.0f;
+    for (std::size_t t = 0; t < c.triangle_count; ++t) {
+        glm::vec3 const n = normal(t);
+        if (n != glm::vec3(0.0f))
+            min_dot = std::min(min_dot, glm::dot(axis, n));
+    }
+    // spread beyond ~84 degrees: the test would hardly ever pass
+    if (min_dot <= 0.1f)
+        return b;
+    b.cone_axis = axis;
+    b.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+    return b;
+}
+
+inline meshlet_data build_meshlets(std::vector<vertex> const & vertices, std::vector<unsigned> const & indices,
+                                   std::size_t max_vertices = meshlet_max_vertices, std::size_t max_triangles = meshlet_max_triangles) {
+    // local indices are 8 bits
+    if (max_vertices < 3 || max_vertices > 256 || max_triangles < 1)
+        throw std::logic_error("meshlet limits out of range");
+
+    meshlet_data out;
+    std::size_t const triangle_count = indices.size() / 3;
+    if (!triangle_count)
+        return out;
+    out.vertices.reserve(vertices.size() + vertices.size() / 4);
+    out.triangles.reserve(triangle_count * 3);
+
+    detail::triangle_adjacency const adjacency(indices, vertices.size());
+    std::vector<glm::vec3> centroids(triangle_count);
+    for (std::size_t t = 0; t < triangle_count; ++t) {
+        centroids[t] = (vertices[indices[t * 3 + 0]].Position + vertices[indices[t * 3 + 1]].Position
+                      + vertices[indices[t * 3 + 2]].Position) / 3.0f;
+    }
+
+    // position of a vertex in the current meshlet
+    constexpr std::uint16_t none = 0xffff;
+    std::vector<std::uint16_t> local(vertices.size(), none);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<unsigned> candidates;   // triangles touching the meshlet, may hold emitted ones
+    meshlet current { 0, 0, 0, 0 };
+    glm::vec3 position_sum { 0.0f };
+
+    auto new_vertices = [&](std::size_t t) {
+        return std::size_t(local[indices[t * 3 + 0]] == none) + std::size_t(local[indices[t * 3 + 1]] == none)
+             + std::size_t(local[indices[t * 3 + 2]] == none);
+    };
+
+    auto add = [&](std::size_t t) {
+        for (std::size_t k = 0; k < 3; ++k) {
+            unsigned const v = indices[t * 3 + k];
+            if (local[v] == none) {
+                local[v] = static_cast<std::uint16_t>(current.vertex_count++);
+                out.vertices.push_back(v);
+                position_sum += vertices[v].Position;
+                for (std::size_t a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; ++a) {
+                    if (!emitted[adjacency.triangles[a]])
+                        candidates.push_back(adjacency.triangles[a]);
+                }
+            }
+            out.triangles.push_back(static_cast<std::uint8_t>(local[v]));
+        }
+        emitted[t] = true;
+        ++current.triangle_count;
+    };
+
+    auto finish = [&] {
+        if (!current.triangle_count)
+            return;
+        for (std::size_t i = 0; i < current.vertex_count; ++i)
+            local[out.vertices[current.vertex_offset + i]] = none;
+        out.meshlets.push_back(current);
+        current = { static_cast<std::uint32_t>(out.vertices.size()), static_cast<std::uint32_t>(out.triangles.size() / 3), 0, 0 };
+        candidates.clear();
+        position_sum = glm::vec3(0.0f);
+    };
+
+    std::size_t cursor = 0;
+    for (std::size_t remaining = triangle_count; remaining > 0; --remaining) {
+        glm::vec3 const center = current.vertex_count ? position_sum / float(current.vertex_count) : glm::vec3(0.0f);
+        std::size_t best = triangle_count;
+        std::size_t best_new = 4;
+        float best_distance = std::numeric_limits<float>::max();
+        std::size_t kept = 0;
+        for (unsigned t : candidates) {
+            if (emitted[t])
+                continue;
+            candidates[kept++] = t;
+            std::size_t const n = new_vertices(t);
+            if (current.vertex_count + n > max_vertices)
+                continue;
+            glm::vec3 const d = centroids[t] - center;
+            float const distance = glm::dot(d, d);
+            if (n < best_new || (n == best_new && distance < best_distance)) {
+                best = t;
+                best_new = n;
+                best_distance = distance;
+            }
+        }
+        bool const connected = kept > 0;
+        candidates.resize(kept);
+
+        if (best == triangle_count) {
+            // every connected triangle would overflow the meshlet
+            if (connected)
+                finish();
+            while (emitted[cursor])
+                ++cursor;
+            if (current.vertex_count + new_vertices(cursor) > max_vertices)
+                finish();
+            best = cursor;
+        }
+        add(best);
+        if (current.triangle_count == max_triangles)
+            finish();
+    }
+    finish();
+
+    out.bounds.reserve(out.meshlets.size());
+    for (auto const & c : out.meshlets)
+        out.bounds.push_back(compute_meshlet_bounds(out, c, vertices));
+    return out;
+}
+
+// import stage: meshlets of every mesh, meshes in parallel on the pool
+inline void build_meshlets(std::vector<mesh_data> & meshes) {
+    workers().parallel_for(meshes.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i)
+            meshes[i].meshlets = build_meshlets(meshes[i].vertices, meshes[i].indices);
+    });
+}
+
+// visible[i] = 1 for the meshlets of m intersecting the frustum that are
+// not back facing from viewer (both in mesh space), returns the number of
+// meshlets culled. cones = false skips the back facing test, for meshes
+// drawn without GL_CULL_FACE.
+inline std::size_t cull_meshlets(meshlet_data const & m, frustum const & f, glm::vec3 viewer,
+                                 std::vector<std::uint8_t> & visible, bool cones = true) {
+    visible.resize(m.meshlets.size());
+    std::size_t culled = 0;
+    for (std::size_t i = 0; i < m.bounds.size(); ++i) {
+        auto const & b = m.bounds[i];
+        bool inside = true;
+        for (auto const & p : f.planes)
+            inside = inside && p.x * b.center.x + p.y * b.center.y + p.z * b.center.z + p.w >= -b.radius;
+        glm::vec3 const d = b.center - viewer;
+        bool const back = cones && glm::dot(d, b.cone_axis) >= b.cone_cutoff * glm::length(d) + b.radius;
+        visible[i] = inside && !back;
+        culled += !visible[i];
+    }
+    return culled;
+}
+
+// appends the triangles of the visible meshlets to out as mesh vertex
+// indices, in meshlet order
+inline void append_meshlet_indices(meshlet_data const & m, std::vector<std::uint8_t> const & visible, std::vector<unsigned> & out) {
+    for (std::size_t i = 0; i < m.meshlets.size(); ++i) {
+        if (!visible[i])
+            continue;
+        auto const & c = m.meshlets[i];
+        unsigned const * vertices = m.vertices.data() + c.vertex_offset;
+        std::uint8_t const * triangles = m.triangles.data() + std::size_t(c.triangle_offset) * 3;
+        for (std::size_t k = 0; k < std::size_t(c.triangle_count) * 3; ++k)
+            out.push_back(vertices[triangles[k]]);
+    }
+}
+
+} // pwgl ns
+#endif
@@ -0,0 +1,887 @@
+// headless model tooling, does not create a GL context
+#include "bvh.hpp"
+#include "frustum.hpp"
+#include "importer.hpp"
+#include "lod_selection.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "meshlet.hpp"
+#include "occlusion.hpp"
+#include "scene_graph.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "fmt/format.h"
+
+namespace {
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int bake(std::string const & path)
+{
+    auto const cache_file = pwgl::mesh_cache::cache_path(path);
+    auto const key = pwgl::mesh_cache::cache_key(path, pwgl::import_key(path));
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<pwgl::node_data> nodes;
+    auto const meshes = pwgl::import_file(path, true, pwgl::tangent_generator::parallel, &nodes);
+    double const import_ms = elapsed_ms(start);
+
+    if (!pwgl::mesh_cache::store(cache_file, key, meshes, nodes))
+        return 1;
+
+    start = std::chrono::steady_clock::now();
+    auto const baked = pwgl::mesh_cache::load(cache_file, key);
+    double const load_ms = elapsed_ms(start);
+    if (!baked) {
+        fmt::print("[-] could not read back: {}\n", cache_file);
+        return 1;
+    }
+
+    fmt::print("[~] {}: meshes: {}, nodes: {}, import: {:.2f} ms, baked: {:.2f} ms\n",
+               cache_file, baked->size(), nodes.size(), import_ms, load_ms);
+    return 0;
+}
+
+// vertex cache statistics before/after the import time optimization
+int optimize(std::string const & path)
+{
+    auto meshes = pwgl::import_file(path, false);
+
+    auto report = [](std::string_view name, std::size_t triangles, std::size_t vertices,
+                     pwgl::vertex_cache_stats const & before, pwgl::vertex_cache_stats const & after,
+                     pwgl::vertex_cache_stats const & overdraw) {
+        fmt::print("{:>10} {:>9} {:>9}   {:6.3f} {:6.3f}   {:6.3f} {:6.3f}   {:6.3f} {:6.3f}\n", name, triangles, vertices,
+                   before.acmr, before.atvr, after.acmr, after.atvr, overdraw.acmr, overdraw.atvr);
+    };
+
+    fmt::print("{}\n", path);
+    fmt::print("{:>10} {:>9} {:>9}   {:>13}   {:>13}   {:>13}\n", "mesh", "triangles", "vertices", "original", "vertex cache", "+ overdraw");
+    fmt::print("{:>10} {:>9} {:>9}   {:>6} {:>6}   {:>6} {:>6}   {:>6} {:>6}\n", "", "", "", "acmr", "atvr", "acmr", "atvr", "acmr", "atvr");
+
+    std::size_t triangles = 0;
+    std::size_t vertices = 0;
+    std::size_t misses[3] { };
+    std::size_t clusters = 0;
+    std::size_t restarts = 0;
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        auto & mesh = meshes[i];
+        auto const before = pwgl::analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+
+        auto with_overdraw = mesh;
+        auto boundaries = mesh.indices;
+        restarts += pwgl::optimize_vertex_cache(boundaries, mesh.vertices.size()).size();
+        pwgl::optimize_mesh(mesh, false);
+        clusters += pwgl::optimize_mesh(with_overdraw, true);
+        auto const after = pwgl::analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+        auto const overdraw = pwgl::analyze_vertex_cache(with_overdraw.indices, with_overdraw.vertices.size());
+
+        report(fmt::format("{}", i), mesh.indices.size() / 3, mesh.vertices.size(), before, after, overdraw);
+        triangles += mesh.indices.size() / 3;
+        vertices += mesh.vertices.size();
+        misses[0] += before.misses;
+        misses[1] += after.misses;
+        misses[2] += overdraw.misses;
+    }
+
+    auto total = [&](std::size_t m) {
+        return pwgl::vertex_cache_stats { m, double(m) / double(std::max<std::size_t>(triangles, 1)), double(m) / double(std::max<std::size_t>(vertices, 1)) };
+    };
+    report("total", triangles, vertices, total(misses[0]), total(misses[1]), total(misses[2]));
+    fmt::print("  overdraw clusters: {} ({} from restarts), {:.1f} triangles per cluster\n", clusters, restarts,
+               double(triangles) / double(std::max<std::size_t>(clusters, 1)));
+    return 0;
+}
+
+// frustum culling throughput on random boxes, scalar reference vs simd
+int cull_bench(std::size_t count)
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> extent(0.1f, 5.0f);
+
+    std::vector<pwgl::bounding_volume> volumes(count);
+    pwgl::bounds_soa soa;
+    for (auto & bv : volumes) {
+        glm::vec3 const c { position(rng), position(rng), position(rng) };
+        glm::vec3 const e { extent(rng), extent(rng), extent(rng) };
+        bv.min = c - e;
+        bv.max = c + e;
+        bv.center = c;
+        bv.radius = glm::length(e);
+        soa.push_back(bv);
+    }
+
+    // 90 degree frustum looking down -z from the origin, near 0.1, far 100
+    pwgl::frustum f;
+    float const s = std::sqrt(0.5f);
+    f.planes = { glm::vec4(s, 0, -s, 0), glm::vec4(-s, 0, -s, 0), glm::vec4(0, s, -s, 0),
+                 glm::vec4(0, -s, -s, 0), glm::vec4(0, 0, -1, -0.1f), glm::vec4(0, 0, 1, 100.0f) };
+
+    constexpr int rounds = 20;
+    std::vector<std::uint8_t> visible(count);
+    std::size_t scalar_visible = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        scalar_visible = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            glm::vec3 const c = (volumes[i].min + volumes[i].max) * 0.5f;
+            glm::vec3 const e = (volumes[i].max - volumes[i].min) * 0.5f;
+            bool inside = true;
+            for (auto const & p : f.planes) {
+                glm::vec3 const n { p.x, p.y, p.z };
+                inside = inside && glm::dot(n, c) + p.w + glm::dot(glm::abs(n), e) >= 0.0f;
+            }
+            visible[i] = inside;
+            scalar_visible += inside;
+        }
+    }
+    double const scalar_ms = elapsed_ms(start) / rounds;
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r)
+        pwgl::cull_boxes(f, soa, visible);
+    double const boxes_ms = elapsed_ms(start) / rounds;
+    std::size_t const box_visible = static_cast<std::size_t>(std::count(std::begin(visible), std::end(visible), 1));
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r)
+        pwgl::cull_spheres(f, soa, visible);
+    double const spheres_ms = elapsed_ms(start) / rounds;
+    std::size_t const sphere_visible = static_cast<std::size_t>(std::count(std::begin(visible), std::end(visible), 1));
+
+    fmt::print("{} volumes\n", count);
+    fmt::print("  scalar boxes: {:8.3f} ms, {:6.2f} ns/box, visible: {}\n", scalar_ms, scalar_ms * 1e6 / double(count), scalar_visible);
+    fmt::print("  simd boxes:   {:8.3f} ms, {:6.2f} ns/box, visible: {}\n", boxes_ms, boxes_ms * 1e6 / double(count), box_visible);
+    fmt::print("  simd spheres: {:8.3f} ms, {:6.2f} ns/box, visible: {}\n", spheres_ms, spheres_ms * 1e6 / double(count), sphere_visible);
+    return scalar_visible == box_visible ? 0 : 1;
+}
+
+// world transform propagation on a random hierarchy of count nodes, built
+// depth first: everything dirty, a few nodes moved, a root moved. checked
+// against a plain glm recomputation of every node.
+int scene_bench(std::size_t count)
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> climb(0, 2);
+    auto random_rotation = [&] {
+        return glm::angleAxis(unit(rng) * 3.14159f, glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.0f, 1e-3f)));
+    };
+
+    pwgl::scene_graph graph;
+    graph.reserve(count);
+    std::vector<std::uint32_t> path;
+    for (std::size_t i = 0; i < count; ++i) {
+        // a root every 10k nodes, below it a random walk in depth
+        if (i % 10000 == 0)
+            path.clear();
+        for (int up = climb(rng); up > 0 && path.size() > 1; --up)
+            path.pop_back();
+        if (path.size() > 32)
+            path.resize(32);
+        std::uint32_t const parent = path.empty() ? pwgl::no_node : path.back();
+        path.push_back(graph.add(parent, glm::vec3(unit(rng), unit(rng), unit(rng)), random_rotation(), glm::vec3(1.0f + 0.01f * unit(rng))));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::size_t const all = graph.update();
+    double const full_ms = elapsed_ms(start);
+
+    std::uniform_int_distribution<std::uint32_t> pick(0, static_cast<std::uint32_t>(count - 1));
+    constexpr int rounds = 200;
+    constexpr int moved = 100;
+    std::size_t few_nodes = 0;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (int k = 0; k < moved; ++k)
+            graph.set_rotation(pick(rng), random_rotation());
+        few_nodes += graph.update();
+    }
+    double const few_ms = elapsed_ms(start) / rounds;
+
+    start = std::chrono::steady_clock::now();
+    graph.set_translation(0, glm::vec3(1.0f, 2.0f, 3.0f));
+    std::size_t const root_nodes = graph.update();
+    double const root_ms = elapsed_ms(start);
+
+    float max_error = 0.0f;
+    std::vector<glm::mat4> reference(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        glm::mat4 const local = glm::translate(glm::mat4(1.0f), graph.translation[i]) * glm::mat4_cast(graph.rotation[i])
+                              * glm::scale(glm::mat4(1.0f), graph.scale[i]);
+        reference[i] = graph.parent[i] == pwgl::no_node ? local : reference[graph.parent[i]] * local;
+        for (int c = 0; c < 4; ++c)
+            for (int k = 0; k < 4; ++k)
+                max_error = std::max(max_error, std::fabs(reference[i][c][k] - graph.world[i][c][k]));
+    }
+
+    fmt::print("{} nodes, {} roots, preorder: {}\n", count, std::count(std::begin(graph.parent), std::end(graph.parent), pwgl::no_node), graph.preorder);
+    fmt::print("  all dirty:     {:8.3f} ms, {:6.2f} ns/node, nodes: {}\n", full_ms, full_ms * 1e6 / double(all), all);
+    fmt::print("  {} moved:     {:8.3f} ms, nodes: {:.0f}\n", moved, few_ms, double(few_nodes) / rounds);
+    fmt::print("  root moved:    {:8.3f} ms, nodes: {}\n", root_ms, root_nodes);
+    fmt::print("  max error against glm: {:g}\n", max_error);
+    return max_error < 1e-3f ? 0 : 1;
+}
+
+// bvh over count random boxes: build, refit after every box moved, frustum
+// and ray queries, checked against testing every box
+int bvh_bench(std::size_t count)
+{
+    std::mt19937 rng(1);
+    // same density at every count: about 1000 boxes per 100^3
+    float const side = 100.0f * std::cbrt(float(count) / 1000.0f);
+    std::uniform_real_distribution<float> position(-side, side);
+    std::uniform_real_distribution<float> extent(0.1f, 5.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<pwgl::bounding_volume> volumes(count);
+    for (auto & bv : volumes) {
+        glm::vec3 const c { position(rng), position(rng), position(rng) };
+        glm::vec3 const e { extent(rng), extent(rng), extent(rng) };
+        bv.min = c - e;
+        bv.max = c + e;
+    }
+
+    pwgl::bvh tree;
+    auto start = std::chrono::steady_clock::now();
+    tree.build(volumes);
+    double const build_ms = elapsed_ms(start);
+    std::size_t leaves = 0;
+    for (auto const & node : tree.nodes)
+        leaves += node.count != 0;
+
+    // everything moves a little, as animated instances would
+    for (auto & bv : volumes) {
+        glm::vec3 const d { unit(rng), unit(rng), unit(rng) };
+        bv.min += d;
+        bv.max += d;
+    }
+    constexpr int rounds = 10;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r)
+        tree.refit(volumes);
+    double const refit_ms = elapsed_ms(start) / rounds;
+
+    // 90 degree frustum looking down -z from the origin, far at side
+    pwgl::frustum f;
+    float const s = std::sqrt(0.5f);
+    f.planes = { glm::vec4(s, 0, -s, 0), glm::vec4(-s, 0, -s, 0), glm::vec4(0, s, -s, 0),
+                 glm::vec4(0, -s, -s, 0), glm::vec4(0, 0, -1, -0.1f), glm::vec4(0, 0, 1, side) };
+    pwgl::bounds_soa soa;
+    for (auto const & bv : volumes)
+        soa.push_back(bv);
+    std::vector<std::uint8_t> visible;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r)
+        pwgl::cull_boxes(f, soa, visible);
+    double const brute_ms = elapsed_ms(start) / rounds;
+
+    std::vector<std::uint32_t> culled;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        culled.clear();
+        tree.cull(f, culled);
+    }
+    double const cull_ms = elapsed_ms(start) / rounds;
+
+    int ret = 0;
+    std::size_t const expected = static_cast<std::size_t>(std::count(std::begin(visible), std::end(visible), 1));
+    std::size_t matching = 0;
+    for (auto item : culled)
+        matching += visible[item];
+    if (culled.size() != expected || matching != expected) {
+        fmt::print("[-] bvh cull: {} visible, brute force {}, matching {}\n", culled.size(), expected, matching);
+        ret = 1;
+    }
+
+    // rays from the origin, a few checked against every box
+    constexpr std::size_t rays = 10000;
+    constexpr std::size_t checked = 50;
+    std::vector<pwgl::ray> queries(rays);
+    for (auto & r : queries)
+        r.direction = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+    std::size_t hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (auto const & r : queries)
+        hits += bool(tree.raycast(r));
+    double const ray_ms = elapsed_ms(start);
+    for (std::size_t i = 0; i < checked; ++i) {
+        auto const & r = queries[i];
+        glm::vec3 const inverse(1.0f / r.direction.x, 1.0f / r.direction.y, 1.0f / r.direction.z);
+        float best = std::numeric_limits<float>::max();
+        for (auto const & bv : volumes)
+            best = std::min(best, pwgl::detail::intersect(bv.min, bv.max, r.origin, inverse, best));
+        if (tree.raycast(r).t != best) {
+            fmt::print("[-] bvh ray {}: {} against {}\n", i, tree.raycast(r).t, best);
+            ret = 1;
+        }
+    }
+
+    fmt::print("{} boxes, {} nodes, {} leaves, {} workers\n", count, tree.nodes.size(), leaves, pwgl::workers().size());
+    fmt::print("  build:  {:8.3f} ms, {:6.1f} ns/box\n", build_ms, build_ms * 1e6 / double(count));
+    fmt::print("  refit:  {:8.3f} ms, {:6.1f} ns/box\n", refit_ms, refit_ms * 1e6 / double(count));
+    fmt::print("  cull:   {:8.3f} ms (every box, simd: {:.3f} ms), visible: {}\n", cull_ms, brute_ms, culled.size());
+    fmt::print("  rays:   {:8.3f} us/ray, hits: {}/{}\n", ray_ms * 1e3 / double(rays), hits, rays);
+    return ret;
+}
+
+// triangles of the box bv, wound counter clockwise seen from outside
+void box_triangles(pwgl::bounding_volume const & bv, std::vector<glm::vec3> & positions, std::vector<unsigned> & indices)
+{
+    positions.clear();
+    indices.clear();
+    for (int i = 0; i < 8; ++i)
+        positions.emplace_back((i & 1) ? bv.max.x : bv.min.x, (i & 2) ? bv.max.y : bv.min.y, (i & 4) ? bv.max.z : bv.min.z);
+    // corner bit per axis: x 1, y 2, z 4
+    constexpr std::array<std::array<unsigned, 4>, 6> faces { {
+        { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 } } };
+    glm::vec3 const center = (bv.min + bv.max) * 0.5f;
+    for (auto const & f : faces) {
+        for (auto const & [a, b, c] : { std::array<unsigned, 3> { f[0], f[1], f[2] }, std::array<unsigned, 3> { f[0], f[2], f[3] } }) {
+            glm::vec3 const normal = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+            bool const outward = glm::dot(normal, positions[a] - center) > 0.0f;
+            indices.insert(indices.end(), { a, outward ? b : c, outward ? c : b });
+        }
+    }
+}
+
+// software rasterized occlusion culling of count random boxes behind a
+// few walls. every box the pyramid culls is rasterized on its own and
+// checked to have no pixel in front of the occluders; of those checked,
+// the boxes with no such pixel give the share the pyramid finds.
+int occlusion_check(std::size_t count)
+{
+    constexpr std::uint32_t width = 320;
+    constexpr std::uint32_t height = 180;
+    constexpr std::size_t checked = 2000;
+    glm::mat4 const view_projection = glm::perspective(glm::radians(60.0f), float(width) / float(height), 0.5f, 500.0f)
+                                    * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    std::mt19937 rng(1);
+    auto uniform = [&rng](float lo, float hi) {
+        return std::uniform_real_distribution<float>(lo, hi)(rng);
+    };
+    auto box = [](glm::vec3 c, glm::vec3 e) {
+        pwgl::bounding_volume bv;
+        bv.min = c - e;
+        bv.max = c + e;
+        bv.center = c;
+        bv.radius = glm::length(e);
+        return bv;
+    };
+
+    // walls facing the camera
+    std::vector<pwgl::bounding_volume> walls;
+    for (int i = 0; i < 32; ++i) {
+        walls.push_back(box({ uniform(-40.0f, 40.0f), uniform(-20.0f, 20.0f), uniform(-80.0f, -15.0f) },
+                            { uniform(2.0f, 10.0f), uniform(2.0f, 10.0f), uniform(0.5f, 3.0f) }));
+    }
+    // boxes in the frustum
+    pwgl::bounds_soa soa;
+    std::vector<pwgl::bounding_volume> candidates;
+    for (std::size_t i = 0; i < count; ++i) {
+        candidates.push_back(box({ uniform(-100.0f, 100.0f), uniform(-50.0f, 50.0f), uniform(-200.0f, -1.0f) },
+                                 { uniform(0.2f, 2.0f), uniform(0.2f, 2.0f), uniform(0.2f, 2.0f) }));
+        soa.push_back(candidates.back());
+    }
+    std::vector<std::uint8_t> in_frustum;
+    pwgl::cull_boxes(pwgl::frustum::from(view_projection), soa, in_frustum);
+    std::vector<pwgl::bounding_volume> boxes;
+    for (std::size_t i = 0; i < count; ++i)
+        if (in_frustum[i])
+            boxes.push_back(candidates[i]);
+
+    pwgl::occlusion_culler culler;
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned> indices;
+    std::vector<pwgl::vertex> vertices;
+    auto start = std::chrono::steady_clock::now();
+    culler.begin(width, height, view_projection);
+    for (auto const & wall : walls) {
+        box_triangles(wall, positions, indices);
+        vertices.resize(positions.size());
+        for (std::size_t i = 0; i < positions.size(); ++i)
+            vertices[i].Position = positions[i];
+        culler.add_occluder(vertices, indices, glm::mat4(1.0f));
+    }
+    culler.end();
+    double const occluder_ms = elapsed_ms(start);
+
+    std::vector<std::uint8_t> visible(boxes.size(), 1);
+    start = std::chrono::steady_clock::now();
+    culler.cull(boxes, visible);
+    double const cull_ms = elapsed_ms(start);
+    auto const culled = static_cast<std::size_t>(std::count(std::begin(visible), std::end(visible), 0));
+
+    // reference: the box on its own against the occluder depth, per pixel
+    auto const & occluder_depth = culler.pyramid.levels[0].depth;
+    pwgl::depth_rasterizer reference;
+    std::size_t hidden = 0;
+    std::size_t hidden_culled = 0;
+    std::size_t violations = 0;
+    for (std::size_t i = 0; i < std::min(checked, boxes.size()); ++i) {
+        reference.clear(width, height);
+        box_triangles(boxes[i], positions, indices);
+        reference.draw(positions, indices, view_projection);
+        reference.resolve();
+        std::size_t in_front = 0;
+        for (std::size_t p = 0; p < reference.depth.size(); ++p)
+            in_front += reference.depth[p] < occluder_depth[p];
+        hidden += in_front == 0;
+        hidden_culled += in_front == 0 && !visible[i];
+        if (in_front && !visible[i]) {
+            if (!violations)
+                fmt::print("[-] box {} culled with {} pixels in front of the occluders\n", i, in_front);
+            ++violations;
+        }
+    }
+
+    fmt::print("{} boxes in the frustum ({} generated), {} occluders, {}x{} depth, {} levels, {} workers\n", boxes.size(), count,
+               walls.size(), width, height, culler.pyramid.levels.size(), pwgl::workers().size());
+    fmt::print("  occluders: {:8.3f} ms (rasterize and build the pyramid)\n", occluder_ms);
+    fmt::print("  test:      {:8.3f} ms, {:6.1f} ns/box, {} culled ({:.1f}%)\n", cull_ms, cull_ms * 1e6 / double(boxes.size()),
+               culled, 100.0 * double(culled) / double(boxes.size()));
+    fmt::print("  checked {}: {} hidden per pixel, {} of them culled, {} culled but visible\n", std::min(checked, boxes.size()),
+               hidden, hidden_culled, violations);
+    return violations || !culled ? 1 : 0;
+}
+
+// OBJ fast path against Assimp on the same file, both without the vertex
+// cache optimization (the same code for both)
+int obj_bench(std::string const & path)
+{
+    auto totals = [](std::vector<pwgl::mesh_data> const & meshes) {
+        std::size_t vertices = 0;
+        std::size_t triangles = 0;
+        for (auto const & m : meshes) {
+            vertices += m.vertices.size();
+            triangles += m.indices.size() / 3;
+        }
+        return std::pair(vertices, triangles);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto const fast = pwgl::import_obj(path, false);
+    double const obj_ms = elapsed_ms(start);
+    auto const [obj_vertices, obj_triangles] = totals(fast);
+
+    start = std::chrono::steady_clock::now();
+    auto const assimp = pwgl::import_model(path, pwgl::import_flags, false);
+    double const assimp_ms = elapsed_ms(start);
+    auto const [assimp_vertices, assimp_triangles] = totals(assimp);
+
+    fmt::print("{} ({} workers)\n", path, pwgl::workers().size());
+    fmt::print("  assimp:     {:10.2f} ms, meshes: {:4}, vertices: {:10}, triangles: {:10}\n",
+               assimp_ms, assimp.size(), assimp_vertices, assimp_triangles);
+    fmt::print("  import_obj: {:10.2f} ms, meshes: {:4}, vertices: {:10}, triangles: {:10}, {:.1f}x\n",
+               obj_ms, fast.size(), obj_vertices, obj_triangles, assimp_ms / std::max(obj_ms, 1e-3));
+    return obj_triangles == assimp_triangles ? 0 : 1;
+}
+
+// Assimp's aiProcess_GenSmoothNormals / aiProcess_CalcTangentSpace against
+// generate_tangent_space() on the meshes imported without them. the
+// deviation compares both where the vertex layouts match.
+int tangent_bench(std::string const & path)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto const assimp = pwgl::import_model(path, pwgl::import_flags, false);
+    double const assimp_ms = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    auto meshes = pwgl::import_model(path, pwgl::import_flags & ~pwgl::tangent_flags, false);
+    double const bare_ms = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    pwgl::generate_tangent_space(meshes);
+    double const parallel_ms = elapsed_ms(start);
+
+    std::size_t vertices = 0;
+    std::size_t compared = 0;
+    double normal_dot = 0.0;
+    double tangent_dot = 0.0;
+    std::size_t flipped = 0;
+    for (std::size_t i = 0; i < meshes.size() && i < assimp.size(); ++i) {
+        vertices += meshes[i].vertices.size();
+        if (meshes[i].vertices.size() != assimp[i].vertices.size())
+            continue;
+        for (std::size_t v = 0; v < meshes[i].vertices.size(); ++v) {
+            auto const & a = assimp[i].vertices[v];
+            auto const & b = meshes[i].vertices[v];
+            if (glm::length(a.Tangent) == 0.0f)
+                continue;
+            normal_dot += glm::dot(a.Normal, b.Normal);
+            tangent_dot += glm::dot(glm::normalize(a.Tangent), b.Tangent);
+            flipped += glm::dot(a.Bitangent, b.Bitangent) < 0.0f;
+            ++compared;
+        }
+    }
+
+    double const n = double(std::max<std::size_t>(compared, 1));
+    fmt::print("{} ({} workers), vertices: {}\n", path, pwgl::workers().size(), vertices);
+    fmt::print("  assimp with tangents:    {:10.2f} ms\n", assimp_ms);
+    fmt::print("  assimp without tangents: {:10.2f} ms\n", bare_ms);
+    fmt::print("  generate_tangent_space:  {:10.2f} ms, {:.1f}x on the tangent part\n", parallel_ms,
+               std::max(assimp_ms - bare_ms, 0.0) / std::max(parallel_ms, 1e-3));
+    fmt::print("  vs assimp: {} vertices, mean normal dot {:.4f}, mean tangent dot {:.4f}, bitangents flipped {}\n",
+               compared, normal_dot / n, tangent_dot / n, flipped);
+    return 0;
+}
+
+// meshlet partition of every mesh, checked for consistency, and the cull
+// rate and cost of the cluster culling pass from viewpoints around the
+// model. every culled cluster is checked to be really invisible.
+int meshlets(std::string const & path)
+{
+    auto meshes = pwgl::import_file(path, true);
+
+    // import_file() has built them already, again for the timing
+    auto start = std::chrono::steady_clock::now();
+    pwgl::build_meshlets(meshes);
+    double const build_ms = elapsed_ms(start);
+
+    std::size_t triangles = 0;
+    std::size_t clusters = 0;
+    std::size_t cluster_vertices = 0;
+    std::size_t errors = 0;
+    pwgl::bounding_volume scene;
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        auto const & mesh = meshes[i];
+        auto const & m = mesh.meshlets;
+        std::vector<std::uint8_t> all(m.meshlets.size(), 1);
+        std::vector<unsigned> indices;
+        pwgl::append_meshlet_indices(m, all, indices);
+
+        // the same triangles as the mesh, in any order
+        auto sorted = [](std::vector<unsigned> const & list) {
+            std::vector<std::array<unsigned, 3>> out;
+            for (std::size_t t = 0; t + 2 < list.size(); t += 3) {
+                std::array<unsigned, 3> tri { list[t], list[t + 1], list[t + 2] };
+                std::rotate(std::begin(tri), std::min_element(std::begin(tri), std::end(tri)), std::end(tri));
+                out.push_back(tri);
+            }
+            std::sort(std::begin(out), std::end(out));
+            return out;
+        };
+        errors += sorted(indices) != sorted(mesh.indices);
+        for (std::size_t c = 0; c < m.meshlets.size(); ++c) {
+            auto const & meshlet = m.meshlets[c];
+            errors += meshlet.vertex_count > pwgl::meshlet_max_vertices || meshlet.triangle_count > pwgl::meshlet_max_triangles;
+            for (std::size_t v = 0; v < meshlet.vertex_count; ++v) {
+                auto const & p = mesh.vertices[m.vertices[meshlet.vertex_offset + v]].Position;
+                errors += glm::distance(p, m.bounds[c].center) > m.bounds[c].radius * 1.0001f + 1e-6f;
+            }
+        }
+
+        triangles += mesh.indices.size() / 3;
+        clusters += m.meshlets.size();
+        cluster_vertices += m.vertices.size();
+        scene.min = i ? glm::min(scene.min, mesh.bounds.min) : mesh.bounds.min;
+        scene.max = i ? glm::max(scene.max, mesh.bounds.max) : mesh.bounds.max;
+    }
+
+    fmt::print("{} ({} workers)\n", path, pwgl::workers().size());
+    fmt::print("  meshes: {}, triangles: {}, meshlets: {}, build: {:.2f} ms\n", meshes.size(), triangles, clusters, build_ms);
+    fmt::print("  per meshlet: {:.1f} triangles ({:.0f}% full), {:.1f} vertices, vertex overhead {:.2f}x\n",
+               double(triangles) / double(std::max<std::size_t>(clusters, 1)),
+               100.0 * double(triangles) / double(std::max<std::size_t>(clusters * pwgl::meshlet_max_triangles, 1)),
+               double(cluster_vertices) / double(std::max<std::size_t>(clusters, 1)),
+               [&] {
+                   std::size_t vertices = 0;
+                   for (auto const & mesh : meshes)
+                       vertices += mesh.vertices.size();
+                   return double(cluster_vertices) / double(std::max<std::size_t>(vertices, 1));
+               }());
+
+    // 64 viewers on a sphere around the model, looking at its center
+    glm::vec3 const center = (scene.min + scene.max) * 0.5f;
+    float const size = std::max(glm::length(scene.max - scene.min), 1e-3f);
+    constexpr int views = 64;
+    std::size_t frustum_culled = 0;
+    std::size_t cone_culled = 0;
+    double cull_ms = 0.0;
+    std::vector<std::uint8_t> in_frustum;
+    std::vector<std::uint8_t> visible;
+    for (int view = 0; view < views; ++view) {
+        float const y = 1.0f - 2.0f * (float(view) + 0.5f) / float(views);
+        float const r = std::sqrt(1.0f - y * y);
+        float const phi = 2.39996323f * float(view);
+        glm::vec3 const eye = center + glm::vec3(r * std::cos(phi), y, r * std::sin(phi)) * size * (0.6f + 0.4f * float(view % 4));
+        glm::mat4 const view_projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.01f * size, 10.0f * size)
+                                        * glm::lookAt(eye, center + glm::vec3(0.2f * size * float(view % 3 - 1), 0.0f, 0.0f),
+                                                      std::fabs(y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0));
+        auto const f = pwgl::frustum::from(view_projection);
+
+        for (auto const & mesh : meshes) {
+            auto const & m = mesh.meshlets;
+            start = std::chrono::steady_clock::now();
+            pwgl::cull_meshlets(m, f, eye, visible);
+            cull_ms += elapsed_ms(start);
+            pwgl::cull_meshlets(m, f, eye, in_frustum, false);
+
+            for (std::size_t c = 0; c < m.meshlets.size(); ++c) {
+                if (visible[c])
+                    continue;
+                auto const & meshlet = m.meshlets[c];
+                if (!in_frustum[c]) {
+                    ++frustum_culled;
+                    continue;
+                }
+                ++cone_culled;
+                // back facing: the viewer is behind every triangle's plane
+                for (std::size_t t = 0; t < meshlet.triangle_count; ++t) {
+                    std::size_t const corner = (meshlet.triangle_offset + t) * 3;
+                    auto position = [&](std::size_t k) {
+                        return mesh.vertices[m.vertices[meshlet.vertex_offset + m.triangles[corner + k]]].Position;
+                    };
+                    glm::vec3 const n = glm::cross(position(1) - position(0), position(2) - position(0));
+                    errors += glm::dot(n, eye - position(0)) > 1e-4f * glm::length(n) * size;
+                }
+            }
+        }
+    }
+
+    double const tested = double(std::max<std::size_t>(clusters * views, 1));
+    fmt::print("  culled over {} views: frustum {:.1f}%, back facing {:.1f}%, {:.1f} ns/meshlet\n", views,
+               100.0 * double(frustum_culled) / tested, 100.0 * double(cone_culled) / tested, cull_ms * 1e6 / tested);
+    if (errors)
+        fmt::print("[-] {}: {} meshlet errors\n", path, errors);
+    return errors ? 1 : 0;
+}
+
+// triangle count and error of every LOD level, per mesh and in total. the
+// error is in model units and relative to the mesh's bounding radius.
+int lods(std::string const & path)
+{
+    auto meshes = pwgl::import_file(path, true);
+
+    // import_file() has built them already, again for the timing
+    auto start = std::chrono::steady_clock::now();
+    pwgl::build_lods(meshes);
+    double const build_ms = elapsed_ms(start);
+
+    fmt::print("{} ({} workers), build: {:.2f} ms\n", path, pwgl::workers().size(), build_ms);
+    fmt::print("{:>6} {:>5} {:>10} {:>7} {:>12} {:>9}\n", "mesh", "lod", "triangles", "ratio", "error", "relative");
+
+    int ret = 0;
+    std::vector<std::size_t> totals;
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        auto const & mesh = meshes[i];
+        std::size_t const base = mesh.indices.size() / 3;
+        fmt::print("{:>6} {:>5} {:>10} {:>7.3f} {:>12.6f} {:>9.5f}\n", i, 0, base, 1.0, 0.0, 0.0);
+        totals.resize(std::max(totals.size(), mesh.lods.size() + 1));
+        totals[0] += base;
+        for (std::size_t l = 0; l < mesh.lods.size(); ++l) {
+            auto const & lod = mesh.lods[l];
+            std::size_t const triangles = lod.indices.size() / 3;
+            fmt::print("{:>6} {:>5} {:>10} {:>7.3f} {:>12.6f} {:>9.5f}\n", "", l + 1, triangles,
+                       double(triangles) / double(std::max<std::size_t>(base, 1)), lod.error,
+                       lod.error / std::max(mesh.bounds.radius, 1e-20f));
+            totals[l + 1] += triangles;
+            bool const valid = lod.indices.size() % 3 == 0 && std::all_of(std::begin(lod.indices), std::end(lod.indices), [&](unsigned v) {
+                return v < mesh.vertices.size();
+            });
+            if (!valid) {
+                fmt::print("[-] mesh {} lod {}: invalid indices\n", i, l + 1);
+                ret = 1;
+            }
+        }
+        // meshes with fewer levels count with their coarsest one
+        for (std::size_t l = mesh.lods.size() + 1; l < totals.size(); ++l)
+            totals[l] += mesh.lods.empty() ? base : mesh.lods.back().indices.size() / 3;
+    }
+    for (std::size_t l = 0; l < totals.size(); ++l)
+        fmt::print("{:>6} {:>5} {:>10} {:>7.3f}\n", l ? "" : "total", l, totals[l], double(totals[l]) / double(std::max<std::size_t>(totals[0], 1)));
+
+    // selection for the mesh with the most levels, 1080p at 45 degrees: the
+    // viewer walks away and back, levels must only get coarser on the way
+    // out and finer on the way back, and switch back closer than they
+    // switched out (hysteresis)
+    auto const deepest = std::max_element(std::begin(meshes), std::end(meshes), [](auto const & a, auto const & b) {
+        return a.lods.size() < b.lods.size();
+    });
+    if (deepest == std::end(meshes) || deepest->lods.empty())
+        return ret;
+    std::vector<float> errors { 0.0f };
+    for (auto const & lod : deepest->lods)
+        errors.push_back(lod.error);
+    auto policy = pwgl::lod_policy::from(glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f), 1080.0f, glm::vec3(0.0f));
+    float const far = deepest->lods.back().error * policy.pixels_per_unit * 2.0f;
+    std::vector<float> out(errors.size(), -1.0f);
+    std::vector<float> back(errors.size(), -1.0f);
+    std::size_t level = 0;
+    constexpr int steps = 4096;
+    for (int s = 0; s <= 2 * steps; ++s) {
+        bool const outward = s <= steps;
+        float const distance = far * float(outward ? s : 2 * steps - s) / float(steps);
+        std::size_t const next = pwgl::select_lod(errors, distance, policy, level);
+        if (outward ? next < level : next > level) {
+            fmt::print("[-] lod selection went {} at distance {}\n", outward ? "finer" : "coarser", distance);
+            ret = 1;
+        }
+        if (outward && next > level)
+            out[next] = distance;
+        if (!outward && next < level)
+            back[level] = distance;
+        level = next;
+    }
+    fmt::print("mesh {} selection (1080p, 45 deg), distance to switch out / back:\n", deepest - std::begin(meshes));
+    for (std::size_t l = 1; l < errors.size(); ++l) {
+        fmt::print("{:>12} {:>12.4f} {:>12.4f}\n", l, out[l], back[l]);
+        if (out[l] >= 0.0f && back[l] >= out[l]) {
+            fmt::print("[-] lod {}: no hysteresis\n", l);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+// writes a wavy grid of about faces triangles with positions, texture
+// coordinates and normals, as input for obj-bench
+int obj_synth(std::size_t faces, std::string const & path)
+{
+    std::FILE * out = std::fopen(path.c_str(), "wb");
+    if (!out) {
+        fmt::print("[-] could not write: {}\n", path);
+        return 1;
+    }
+
+    auto const quads = static_cast<std::size_t>(std::ceil(std::sqrt(double(std::max<std::size_t>(faces, 2)) / 2.0)));
+    std::size_t const side = quads + 1;
+    fmt::memory_buffer buffer;
+    auto flush = [&](bool force) {
+        if (force || buffer.size() > (1 << 20)) {
+            std::fwrite(buffer.data(), 1, buffer.size(), out);
+            buffer.clear();
+        }
+    };
+
+    fmt::format_to(std::back_inserter(buffer), "# meshtool obj-synth: {} triangles\no grid\n", quads * quads * 2);
+    for (std::size_t z = 0; z < side; ++z) {
+        for (std::size_t x = 0; x < side; ++x) {
+            float const u = float(x) / float(quads);
+            float const v = float(z) / float(quads);
+            float const h = 0.05f * std::sin(u * 40.0f) * std::cos(v * 40.0f);
+            glm::vec3 const n = glm::normalize(glm::vec3(-2.0f * std::cos(u * 40.0f) * std::cos(v * 40.0f), 1.0f,
+                                                         2.0f * std::sin(u * 40.0f) * std::sin(v * 40.0f)));
+            fmt::format_to(std::back_inserter(buffer), "v {:.6f} {:.6f} {:.6f}\nvt {:.6f} {:.6f}\nvn {:.6f} {:.6f} {:.6f}\n",
+                           u, h, v, u, v, n.x, n.y, n.z);
+        }
+        flush(false);
+    }
+    for (std::size_t z = 0; z < quads; ++z) {
+        for (std::size_t x = 0; x < quads; ++x) {
+            std::size_t const a = z * side + x + 1;
+            std::size_t const b = a + 1;
+            std::size_t const c = a + side;
+            std::size_t const d = c + 1;
+            fmt::format_to(std::back_inserter(buffer), "f {0}/{0}/{0} {2}/{2}/{2} {1}/{1}/{1}\nf {1}/{1}/{1} {2}/{2}/{2} {3}/{3}/{3}\n",
+                           a, b, c, d);
+        }
+        flush(false);
+    }
+    flush(true);
+    bool const ok = std::fclose(out) == 0;
+    fmt::print("[~] {}: {} vertices, {} triangles\n", path, side * side, quads * quads * 2);
+    return ok ? 0 : 1;
+}
+
+void usage()
+{
+    fmt::print("usage: meshtool <command> <model>...\n");
+    fmt::print("  bake       write the binary mesh cache next to each model\n");
+    fmt::print("  optimize   report vertex cache efficiency (acmr/atvr, fifo of 16) before and after optimization\n");
+    fmt::print("  obj-bench  time the OBJ fast path against Assimp (.obj files)\n");
+    fmt::print("  tangent-bench  time parallel normal/tangent generation against Assimp's\n");
+    fmt::print("  meshlets   build, check and cull meshlets, report their fill and cull rates\n");
+    fmt::print("  lods       simplify into the LOD chain, print triangles and error per level\n");
+    fmt::print("usage: meshtool cull-bench <count>...\n");
+    fmt::print("usage: meshtool scene-bench <nodes>...\n");
+    fmt::print("usage: meshtool bvh-bench <count>...\n");
+    fmt::print("usage: meshtool occlusion-check <count>...\n");
+    fmt::print("usage: meshtool obj-synth <triangles> <file.obj>\n");
+}
+
+} // anon ns
+
+int main(int argc, char ** argv)
+{
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+
+    std::string_view const command = argv[1];
+    std::vector<std::string> const files(argv + 2, argv + argc);
+
+    int ret = 0;
+    if (command == "cull-bench") {
+        for (auto const & count : files)
+            ret |= cull_bench(std::stoul(count));
+        return ret;
+    }
+    if (command == "bvh-bench") {
+        for (auto const & count : files)
+            ret |= bvh_bench(std::stoul(count));
+        return ret;
+    }
+    if (command == "occlusion-check") {
+        for (auto const & count : files)
+            ret |= occlusion_check(std::stoul(count));
+        return ret;
+    }
+    if (command == "scene-bench") {
+        for (auto const & count : files)
+            ret |= scene_bench(std::stoul(count));
+        return ret;
+    }
+
+    try {
+        if (command == "obj-synth") {
+            if (files.size() != 2) {
+                usage();
+                return 1;
+            }
+            return obj_synth(std::stoul(files[0]), files[1]);
+        }
+        for (auto const & file : files) {
+            if (command == "bake")
+                ret |= bake(file);
+            else if (command == "optimize")
+                ret |= optimize(file);
+            else if (command == "obj-bench")
+                ret |= obj_bench(file);
+            else if (command == "tangent-bench")
+                ret |= tangent_bench(file);
+            else if (command == "meshlets")
+                ret |= meshlets(file);
+            else if (command == "lods")
+                ret |= lods(file);
+            else {
+                usage();
+                return 1;
+            }
+        }
+    } catch (std::exception const & e) {
+        fmt::print("[-] {}\n", e.what());
+        return 1;
+    }
+    return ret;
+}
@@ -5,15 +5,26 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
-
 #include <stb_image.h>
+#include "frustum.hpp"
+#include "image.hpp"
+#include "importer.hpp"
+#include "mesh_cache.hpp"
 #include "mesh.hpp"
+#include "meshlet.hpp"
+#include "ring_buffer.hpp"
+#include "scene_graph.hpp"
 #include "shader.hpp"
+#include "texture_cache.hpp"
+#include "thread_pool.hpp"
 //#include <learnopengl/shader.h>
 
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <limits>
+#include <memory>
+#include <span>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -23,178 +34,89 @@
 
 namespace {
 
-unsigned texture_from_file(std::string filename, std::string directory, std::size_t indent = 0)
+[[maybe_unused]] unsigned texture_from_file(std::string filename, std::string directory, std::size_t indent = 0)
 {
     fmt::print("{} texture_from_file: filename: {}, directory: {}\n", std::string(indent, ' '), filename, directory);
-
-    unsigned textureID;
-    glGenTextures(1, &textureID);
-
-    int width = 0;
-    int height = 0;
-    int nrComponents = 0;
-    filename = directory + '/' + filename;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-        else
-            assert(false && "incorrect number of components");
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, static_cast<int>(format), width, height, 0, static_cast<unsigned>(format), GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    } else {
-        fmt::print("Texture failed to load at file: {}\n", filename);
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return pwgl::upload_image(pwgl::decode_image(directory + '/' + filename), indent);
 }
 
-std::vector<pwgl::texture> load_material_textures(std::string directory, aiMaterial *mat, aiTextureType type, std::string typeName, std::size_t indent = 0) {
-    fmt::print("{} {} directory: {}, textures: {}, typename: {}\n", std::string(indent, ' '), __func__, directory, mat->GetTextureCount(type), typeName);
-    std::vector<pwgl::texture> textures;
-    for (unsigned i = 0; i < mat->GetTextureCount(type); i++) {
-        aiString str;
-        mat->GetTexture(type, i, &str);
-
-        pwgl::texture texture;
-        texture.id = texture_from_file(str.C_Str(), directory, indent);
-        texture.type = typeName;
-        texture.path = str.C_Str();
-        textures.emplace_back(texture);
+// resolves every texture referenced by the meshes through the process wide
+// texture cache; images not yet resident are decoded on the worker pool and
+// uploaded on the calling (GL) thread in the order they complete
+void load_material_textures(std::string const & directory, std::vector<pwgl::mesh_data> & meshes,
+                            std::vector<std::shared_ptr<pwgl::texture_handle>> & textures_loaded, std::size_t indent = 0) {
+    std::map<pwgl::texture_key, std::vector<pwgl::texture *>> users;
+    std::size_t references = 0;
+    for (auto & mesh : meshes) {
+        for (auto & texture : mesh.textures) {
+            users[pwgl::texture_key::from(directory + '/' + texture.path)].emplace_back(&texture);
+            ++references;
+        }
     }
-    return textures;
-}
 
-
-pwgl::mesh process_mesh(std::string directory, aiMesh *mesh, const aiScene *scene, std::size_t indent = 4)
-{
-    std::vector<pwgl::vertex> vertices;
-    std::vector<unsigned> indices;
-    std::vector<pwgl::texture> textures;
-
-    // walk through each of the mesh's vertices
-    for(unsigned i = 0; i < mesh->mNumVertices; i++) {
-        pwgl::vertex vertex;
-
-        // location 0: position
-        vertex.Position = {
-            mesh->mVertices[i].x,
-            mesh->mVertices[i].y,
-            mesh->mVertices[i].z
-        };
-
-        // location 1: normals
-        if (mesh->HasNormals()) {
-            vertex.Normal = {
-                mesh->mNormals[i].x,
-                mesh->mNormals[i].y,
-                mesh->mNormals[i].z
-            };
+    auto & cache = pwgl::texture_cache::instance();
+    auto resolve = [&](pwgl::texture_key const & key, std::shared_ptr<pwgl::texture_handle> handle) {
+        for (auto * texture : users[key])
+            texture->id = handle->id;
+        textures_loaded.emplace_back(std::move(handle));
+    };
+
+    std::vector<std::pair<pwgl::texture_key, std::future<pwgl::decoded_image>>> pending;
+    for (auto const & [key, _] : users) {
+        if (auto handle = cache.find(key)) {
+            resolve(key, std::move(handle));
+            continue;
         }
+        pending.emplace_back(key, pwgl::workers().submit([key] {
+            return pwgl::decode_image(key.path, key.channels);
+        }));
+    }
 
-        // location 2: texture coords.
-        if(mesh->mTextureCoords[0]) {
-            vertex.TexCoords = {
-                mesh->mTextureCoords[0][i].x,
-                mesh->mTextureCoords[0][i].y
-            };
-            // tangent
-            vertex.Tangent = {
-                mesh->mTangents[i].x,
-                mesh->mTangents[i].y,
-                mesh->mTangents[i].z
-            };
-            // bitangent
-            vertex.Bitangent = {
-                mesh->mBitangents[i].x,
-                mesh->mBitangents[i].y,
-                mesh->mBitangents[i].z
-            };
-        } else {
-            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-        }
+    fmt::print("{} {} directory: {}, references: {}, images: {}, decoding: {}, workers: {}\n", std::string(indent, ' '), __func__,
+               directory, references, users.size(), pending.size(), pwgl::workers().size());
 
-        vertices.emplace_back(vertex);
-    }
+    while (!pending.empty()) {
+        auto ready = std::find_if(std::begin(pending), std::end(pending), [](auto const & p) {
+            return p.second.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        });
+        if (ready == std::end(pending)) {
+            pending.front().second.wait();
+            ready = std::begin(pending);
+        }
 
-    for(unsigned i = 0; i < mesh->mNumFaces; i++) {
-        aiFace face = mesh->mFaces[i];
-        for(unsigned j = 0; j < face.mNumIndices; j++)
-            indices.emplace_back(face.mIndices[j]);
+        unsigned const id = pwgl::upload_image(ready->second.get(), indent);
+        resolve(ready->first, cache.insert(ready->first, id));
+        pending.erase(ready);
     }
-    aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-
-    // 1. diffuse maps
-    std::vector<pwgl::texture> diffuseMaps = load_material_textures(directory, material, aiTextureType_DIFFUSE, "texture_diffuse", indent + 4);
-    textures.insert(std::end(textures), std::begin(diffuseMaps), std::end(diffuseMaps));
-    // 2. specular maps
-    std::vector<pwgl::texture> specularMaps = load_material_textures(directory, material, aiTextureType_SPECULAR, "texture_specular", indent + 4);
-    textures.insert(std::end(textures), std::begin(specularMaps), std::end(specularMaps));
-    // 3. normal maps
-    std::vector<pwgl::texture> normalMaps = load_material_textures(directory, material, aiTextureType_HEIGHT, "texture_normal", indent + 4);
-    textures.insert(textures.end(), std::begin(normalMaps), std::end(normalMaps));
-    // 4. height maps
-    std::vector<pwgl::texture> heightMaps = load_material_textures(directory, material, aiTextureType_AMBIENT, "texture_height", indent + 4);
-    textures.insert(std::end(textures), std::begin(heightMaps), std::end(heightMaps));
-
-    fmt::print("{} process_mesh: creating mesh, vertices: {}, indices: {}, textures: {}\n",
-               std::string(indent, ' '),  vertices.size(), indices.size(), textures.size());
-
-    return pwgl::mesh(vertices, indices, textures);
+    cache.print_stats();
 }
 
-void processNode(std::string directory, std::vector<pwgl::mesh> & meshes, aiNode *node, const aiScene *scene, int child = 0, int max_children = 0, std::size_t indent = 4)
-{
-    fmt::print("{} [{}/{}]processNode, meshes: {}, children: {}\n", std::string(indent, ' '),
-               child, max_children, node->mNumMeshes, node->mNumChildren);
-
-    for (unsigned i = 0; i < node->mNumMeshes; i++) {
-        aiMesh * mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.emplace_back(
-            process_mesh(directory, mesh, scene, indent + 4)
-        );
+// imported mesh data and node hierarchy, from the bake cache when it is up
+// to date
+std::vector<pwgl::mesh_data> load_mesh_data(std::string const & path, std::vector<pwgl::node_data> & nodes,
+                                            pwgl::tangent_generator generator = pwgl::tangent_generator::parallel) {
+    auto const cache_file = pwgl::mesh_cache::cache_path(path);
+    auto const key = pwgl::mesh_cache::cache_key(path, pwgl::import_key(path, generator));
+    if (auto cached = pwgl::mesh_cache::load(cache_file, key, &nodes)) {
+        fmt::print("[~] loaded baked model: \"{}\", meshes: {}, nodes: {}\n", cache_file, cached->size(), nodes.size());
+        return std::move(*cached);
     }
 
-    //fmt::print("{} [{}/{}]processNode, children: {}\n", std::string(indent, ' '), child, max_children, node->mNumChildren);
-
-    for (unsigned i = 0; i < node->mNumChildren; i++) {
-        processNode(directory, meshes, node->mChildren[i], scene,
-                    int(i), int(node->mNumChildren), indent + 4);
-    }
+    auto meshes = pwgl::import_file(path, true, generator, &nodes);
+    if (pwgl::mesh_cache::store(cache_file, key, meshes, nodes))
+        fmt::print("[~] baked model: \"{}\"\n", cache_file);
+    return meshes;
 }
 
-void loadModel(std::vector<pwgl::mesh> & meshes, std::string const & path) {
+void loadModel(std::vector<pwgl::mesh> & meshes, pwgl::vertex_arena & arena, std::vector<std::shared_ptr<pwgl::texture_handle>> & textures_loaded,
+               std::vector<pwgl::node_data> & nodes, std::string const & path, pwgl::vertex_format format) {
     fmt::print("loadModel: name: {}\n", path);
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile( path,
-        aiProcess_Triangulate
-      | aiProcess_GenSmoothNormals
-      | aiProcess_FlipUVs
-      | aiProcess_CalcTangentSpace
-    );
-    if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-        fmt::print("ERROR::ASSIMP:: {}\n", importer.GetErrorString());
-        throw std::logic_error("could not initialize pwgl::model");
-    }
-
     std::string directory = path.substr(0, path.find_last_of('/'));
-    processNode(directory, meshes, scene->mRootNode, scene,
-                0, 0, 4);
+    auto data = load_mesh_data(path, nodes);
+    load_material_textures(directory, data, textures_loaded, 4);
+    auto const plan = arena.build(data, format);
+    for (std::size_t i = 0; i < data.size(); ++i)
+        meshes.emplace_back(std::move(data[i]), plan.ranges[i], plan.lods[i]);
 }
 
 } // anon ns
@@ -202,22 +124,222 @@ void loadModel(std::vector<pwgl::mesh> & meshes, std::string const & path) {
 namespace pwgl {
 
 struct model {
-    model(std::string path) {
+    // empty, filled progressively by pwgl::model_loader
+    model() = default;
+    model(std::string path, pwgl::vertex_format format = pwgl::vertex_format::full) {
         stbi_set_flip_vertically_on_load(true);
-        loadModel(meshes, path);
+        std::vector<pwgl::node_data> hierarchy;
+        loadModel(meshes, arena, textures_loaded, hierarchy, path, format);
+        set_nodes(hierarchy);
+        for (auto const & mesh : meshes)
+            bounds.push_back(transform_bounds(mesh.bounds, nodes.world[mesh.node]));
+        loaded = true;
     }
     ~model() {
         fmt::print("~model()\n");
     }
-    void draw(pwgl::shader &shader)
+    // precompute the texture bindings of every mesh for a shader
+    void bind_material(pwgl::shader const & shader) {
+        for (auto & mesh : meshes)
+            mesh.bind_material(shader);
+    }
+
+    // replaces the node hierarchy, an empty one stands for a single root
+    void set_nodes(std::span<pwgl::node_data const> hierarchy) {
+        nodes = hierarchy.empty() ? pwgl::scene_graph() : pwgl::scene_graph(hierarchy);
+        if (hierarchy.empty())
+            nodes.add();
+        nodes.update();
+    }
+
+    // brings the node world matrices up to date after nodes were moved,
+    // and with them the model space bounds of the meshes
+    void update_nodes() {
+        if (!nodes.update())
+            return;
+        for (std::size_t i = 0; i < meshes.size(); ++i)
+            bounds.set(i, transform_bounds(meshes[i].bounds, nodes.world[meshes[i].node]));
+    }
+
+    // box around every mesh in model space, node transforms applied. grows
+    // while the loader adds meshes.
+    pwgl::bounding_volume extent() const {
+        pwgl::bounding_volume bv;
+        if (!bounds.size())
+            return bv;
+        bv.min = glm::vec3(std::numeric_limits<float>::max());
+        bv.max = glm::vec3(-std::numeric_limits<float>::max());
+        for (std::size_t i = 0; i < bounds.size(); ++i) {
+            glm::vec3 const c(bounds.cx[i], bounds.cy[i], bounds.cz[i]);
+            glm::vec3 const e(bounds.ex[i], bounds.ey[i], bounds.ez[i]);
+            bv.min = glm::min(bv.min, c - e);
+            bv.max = glm::max(bv.max, c + e);
+        }
+        bv.center = (bv.min + bv.max) * 0.5f;
+        bv.radius = glm::length(bv.max - bv.center);
+        return bv;
+    }
+
+    // model matrix of mesh i drawn with transform
+    glm::mat4 mesh_transform(std::size_t i, glm::mat4 const & transform) const {
+        return transform * nodes.world[meshes[i].node];
+    }
+
+    // draws every mesh with model_u set to transform times its node's
+    // world matrix
+    void draw(pwgl::shader &shader, uniform_handle model_u, glm::mat4 const & transform)
     {
-        for(unsigned i = 0; i < meshes.size(); i++)
+        arena.bind();
+        shader.set(shader.uniform("vertex_packed"), arena.format == pwgl::vertex_format::packed ? 1 : 0);
+        for (std::size_t i = 0; i < meshes.size(); i++) {
+            shader.set(model_u, mesh_transform(i, transform));
             meshes[i].draw(shader);
+        }
+    }
+
+    // as draw(), only the meshes whose bounds intersect the view frustum
+    void draw(pwgl::shader &shader, uniform_handle model_u, glm::mat4 const & transform, glm::mat4 const & view_projection)
+    {
+        pwgl::cull_boxes(pwgl::frustum::from(view_projection * transform), bounds, visible);
+
+        arena.bind();
+        shader.set(shader.uniform("vertex_packed"), arena.format == pwgl::vertex_format::packed ? 1 : 0);
+        culled = 0;
+        for (std::size_t i = 0; i < meshes.size(); i++) {
+            if (!visible[i]) {
+                ++culled;
+                continue;
+            }
+            shader.set(model_u, mesh_transform(i, transform));
+            meshes[i].draw(shader);
+        }
+    }
+
+    // draws the meshlets that intersect the view frustum and face viewer
+    // (world space). the surviving triangles of all meshes are written to
+    // stream as one 32 bit index list, which stands in for the arena's
+    // index buffer during the draws. the model transform has to keep angles
+    // (rotation, translation, uniform scale) for the cones.
+    void draw_clusters(pwgl::shader &shader, pwgl::ring_buffer & stream, uniform_handle model_u, glm::mat4 const & transform,
+                       glm::mat4 const & view_projection, glm::vec3 viewer)
+    {
+        pwgl::cull_boxes(pwgl::frustum::from(view_projection * transform), bounds, visible);
+
+        culled = 0;
+        cluster_indices.clear();
+        cluster_draws.clear();
+        for (std::size_t i = 0; i < meshes.size(); i++) {
+            if (!visible[i]) {
+                ++culled;
+                continue;
+            }
+            // meshlet bounds are in mesh space
+            glm::mat4 const world = mesh_transform(i, transform);
+            glm::vec3 const mesh_viewer(glm::inverse(world) * glm::vec4(viewer, 1.0f));
+            auto const & meshlets = meshes[i].meshlets;
+            stats().clusters_culled += pwgl::cull_meshlets(meshlets, pwgl::frustum::from(view_projection * world), mesh_viewer, cluster_visible);
+            std::size_t const first = cluster_indices.size();
+            pwgl::append_meshlet_indices(meshlets, cluster_visible, cluster_indices);
+            if (cluster_indices.size() > first)
+                cluster_draws.push_back({ i, first, cluster_indices.size() - first, false, 0 });
+        }
+        if (cluster_draws.empty())
+            return;
+
+        // what does not fit into the frame's region is drawn whole from the
+        // arena, unculled, rather than throwing mid-frame
+        for (auto & d : cluster_draws) {
+            std::size_t const bytes = d.count * sizeof(unsigned);
+            d.streamed = stream.available(sizeof(unsigned)) >= bytes;
+            if (d.streamed)
+                d.offset = stream.write(cluster_indices.data() + d.first, bytes, sizeof(unsigned)).offset;
+        }
+        stream.flush();
+
+        arena.bind();
+        shader.set(shader.uniform("vertex_packed"), arena.format == pwgl::vertex_format::packed ? 1 : 0);
+        gl().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, stream.buffer);
+        for (auto const & d : cluster_draws) {
+            if (!d.streamed)
+                continue;
+            auto & mesh = meshes[d.mesh];
+            pwgl::mesh_range range = mesh.range;
+            range.index_offset = d.offset;
+            range.index_count = d.count;
+            range.index_type = GL_UNSIGNED_INT;
+            mesh.bind(shader);
+            shader.set(model_u, mesh_transform(d.mesh, transform));
+            vertex_arena::draw(range);
+        }
+        gl().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, arena.ebo);
+        for (auto const & d : cluster_draws) {
+            if (d.streamed)
+                continue;
+            auto & mesh = meshes[d.mesh];
+            mesh.bind(shader);
+            shader.set(model_u, mesh_transform(d.mesh, transform));
+            vertex_arena::draw(mesh.range);
+        }
+    }
+
+    // draws every mesh once per transform with glDrawElementsInstanced, the
+    // shader takes the model matrix (and color) from the instance attributes
+    // written to stream. the instance matrices are transform times the
+    // mesh's node world matrix, streamed again whenever the node changes
+    // from one mesh to the next.
+    void draw_instanced(pwgl::shader &shader, pwgl::ring_buffer & stream, std::span<glm::mat4 const> transforms, std::span<glm::vec4 const> colors = { })
+    {
+        if (transforms.empty())
+            return;
+
+        arena.bind();
+        shader.set(shader.uniform("vertex_packed"), arena.format == pwgl::vertex_format::packed ? 1 : 0);
+        shader.set(shader.uniform("instanced"), 1);
+        std::uint32_t streamed = ~0u;   // node of the instance matrices in the stream
+        for (auto & mesh : meshes) {
+            if (mesh.node != streamed) {
+                glm::mat4 const & node = nodes.world[mesh.node];
+                std::span<glm::mat4 const> instances = transforms;
+                if (node != glm::mat4(1.0f)) {
+                    instance_transforms.clear();
+                    for (auto const & t : transforms)
+                        instance_transforms.push_back(t * node);
+                    instances = instance_transforms;
+                }
+                arena.begin_instances(stream, instances, colors);
+                streamed = mesh.node;
+            }
+            mesh.draw(shader, transforms.size());
+        }
+        shader.set(shader.uniform("instanced"), 0);
+        arena.end_instances();
     }
 
     std::vector<pwgl::mesh> meshes;
-    std::vector<pwgl::texture> textures_loaded;
+    pwgl::scene_graph nodes;    // mesh::node indexes it
+    pwgl::bounds_soa bounds;    // per mesh, model space (node transform applied)
+    std::vector<std::uint8_t> visible;
+    std::size_t culled { };     // meshes, by the last frustum culled draw
+    pwgl::vertex_arena arena;
+    std::vector<std::shared_ptr<pwgl::texture_handle>> textures_loaded;
     std::string directory;
+    bool loaded { };            // every mesh and texture is resident
+    std::size_t revision { };   // bumped whenever meshes or their textures change
+
+private:
+    // per frame scratch of draw_clusters(), keeps its capacity
+    struct cluster_draw {
+        std::size_t mesh;
+        std::size_t first;
+        std::size_t count;
+        bool streamed;          // else drawn from the arena's ranges
+        std::size_t offset;     // of the indices in stream
+    };
+    std::vector<std::uint8_t> cluster_visible;
+    std::vector<unsigned> cluster_indices;
+    std::vector<cluster_draw> cluster_draws;
+    // per node instance matrices of draw_instanced()
+    std::vector<glm::mat4> instance_transforms;
 };
 
 } // pwgl ns
@@ -0,0 +1,273 @@
+#ifndef MODEL_LOADER_HPP
+#define MODEL_LOADER_HPP
+
+#include <GL/glew.h>
+
+#include "frame_stats.hpp"
+#include "model.hpp"
+#include "texture_cache.hpp"
+#include "thread_pool.hpp"
+#include "upload_thread.hpp"
+#include "vertex_arena.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Streaming model loading. load() returns an empty model at once; import
+// (Assimp or the bake cache), vertex conversion and image decoding run on
+// the worker pool, and update() drip-feeds the GL uploads from the render
+// loop within a per frame time budget. Meshes become drawable one by one,
+// their textures show a placeholder until the real image is uploaded.
+//
+// A single upload is never split, so one large texture can still exceed
+// the budget of its frame. With a pwgl::upload_thread the copies leave the
+// render thread altogether: update() hands every ready mesh and image to
+// the upload context and only publishes those whose fences have passed.
+
+namespace pwgl {
+
+class model_loader {
+public:
+    explicit model_loader(std::chrono::microseconds frame_budget = std::chrono::milliseconds(2),
+                          upload_thread * upload_context = nullptr)
+        : budget(frame_budget)
+        , uploads(upload_context)
+    {
+        stbi_set_flip_vertically_on_load(true);
+
+        // 1x1 mid grey, shown until a mesh's textures are resident
+        std::array<std::uint8_t, 4> const grey { 128, 128, 128, 255 };
+        unsigned id = 0;
+        glGenTextures(1, &id);
+        gl().bind_texture(0, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        placeholder = std::make_shared<texture_handle>(id);
+    }
+    model_loader(model_loader const &) = delete;
+    model_loader & operator=(model_loader const &) = delete;
+
+    // the model is filled in by update(), model::loaded is set once the
+    // last mesh and texture are resident
+    std::shared_ptr<model> load(std::string path, vertex_format format = vertex_format::full,
+                                tangent_generator generator = tangent_generator::parallel) {
+        fmt::print("[~] model_loader: loading \"{}\"\n", path);
+        auto & j = jobs.emplace_back();
+        j.path = path;
+        j.target = std::make_shared<model>();
+        j.target->directory = path.substr(0, path.find_last_of('/'));
+        j.target->textures_loaded.push_back(placeholder);
+        j.start = std::chrono::steady_clock::now();
+        j.import = workers().submit([path, format, generator] {
+            auto data = std::make_shared<imported>();
+            data->meshes = load_mesh_data(path, data->nodes, generator);
+            data->plan = vertex_arena::plan(data->meshes, format);
+            return data;
+        });
+        return j.target;
+    }
+
+    // GL thread, once per frame before the draws are recorded: uploads
+    // until the frame budget is spent, but at least one item so loading
+    // always progresses
+    void update() {
+        if (jobs.empty())
+            return;
+
+        auto const start = std::chrono::steady_clock::now();
+        auto const deadline = start + budget;
+        bool first = true;
+        auto has_time = [&] {
+            bool const ok = first || std::chrono::steady_clock::now() < deadline;
+            first = false;
+            return ok;
+        };
+
+        for (auto & j : jobs) {
+            if (!j.started) {
+                if (!ready(j.import))
+                    continue;
+                if (!begin_upload(j))
+                    continue;
+            }
+            if (uploads) {
+                stream(j);
+                continue;
+            }
+            while (j.next_mesh < j.data->meshes.size() && has_time())
+                upload_mesh(j);
+            for (auto it = std::begin(j.textures); it != std::end(j.textures);) {
+                if (!ready(it->image) || !has_time()) {
+                    ++it;
+                    continue;
+                }
+                upload_texture(j, *it);
+                it = j.textures.erase(it);
+            }
+        }
+
+        std::erase_if(jobs, [](job const & j) {
+            if (j.failed)
+                return true;
+            if (!j.started || j.target->meshes.size() < j.data->meshes.size() || !j.textures.empty())
+                return false;
+            j.target->loaded = true;
+            fmt::print("[~] model_loader: \"{}\" loaded in {:.1f} ms\n", j.path,
+                       std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - j.start).count());
+            return true;
+        });
+        stats().upload_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::size_t pending() const {
+        return jobs.size();
+    }
+
+private:
+    struct imported {
+        std::vector<mesh_data> meshes;
+        std::vector<node_data> nodes;
+        arena_plan plan;
+    };
+
+    struct pending_texture {
+        texture_key key;
+        std::future<decoded_image> image;
+        upload_ticket upload;   // upload thread, once decoded
+        std::vector<std::pair<std::size_t, std::size_t>> users;    // (mesh, texture)
+    };
+
+    struct job {
+        std::string path;
+        std::shared_ptr<model> target;
+        std::future<std::shared_ptr<imported>> import;
+        std::shared_ptr<imported> data;     // shared with the upload thread
+        std::vector<pending_texture> textures;
+        std::deque<upload_ticket> mesh_uploads;
+        std::size_t next_mesh { };
+        bool started { };
+        bool failed { };
+        std::chrono::steady_clock::time_point start;
+    };
+
+    template <typename T>
+    static bool ready(std::future<T> const & f) {
+        return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // takes the imported meshes, allocates the arena and starts decoding
+    // the textures that are not resident yet
+    bool begin_upload(job & j) {
+        j.started = true;
+        try {
+            j.data = j.import.get();
+        } catch (std::exception const & e) {
+            fmt::print("[-] model_loader: \"{}\": {}\n", j.path, e.what());
+            j.failed = true;
+            return false;
+        }
+
+        auto & target = *j.target;
+        target.set_nodes(j.data->nodes);
+        target.meshes.reserve(j.data->meshes.size());
+        target.arena.allocate(j.data->plan);
+
+        auto & cache = texture_cache::instance();
+        for (std::size_t m = 0; m < j.data->meshes.size(); ++m) {
+            auto & textures = j.data->meshes[m].textures;
+            for (std::size_t t = 0; t < textures.size(); ++t) {
+                auto const key = texture_key::from(target.directory + '/' + textures[t].path);
+                if (auto handle = cache.find(key)) {
+                    textures[t].id = handle->id;
+                    target.textures_loaded.push_back(std::move(handle));
+                    continue;
+                }
+                textures[t].id = placeholder->id;
+                auto it = std::find_if(std::begin(j.textures), std::end(j.textures), [&](auto const & p) { return p.key == key; });
+                if (it == std::end(j.textures))
+                    it = j.textures.insert(it, { key, workers().submit([key] { return decode_image(key.path, key.channels); }), { }, { } });
+                it->users.emplace_back(m, t);
+            }
+        }
+        return true;
+    }
+
+    void upload_mesh(job & j) {
+        std::size_t const i = j.next_mesh++;
+        j.target->arena.upload(j.data->plan, j.data->meshes, i);
+        add_mesh(j);
+    }
+
+    void upload_texture(job & j, pending_texture & p) {
+        add_texture(j, p, upload_image(p.image.get(), 4));
+    }
+
+    // upload thread path: queues everything that is ready, publishes the
+    // meshes in order and the textures as their copies complete
+    void stream(job & j) {
+        auto & target = *j.target;
+        for (; j.next_mesh < j.data->meshes.size(); ++j.next_mesh)
+            j.mesh_uploads.emplace_back(uploads->write_buffers(target.arena.writes(j.data->plan, j.data->meshes, j.next_mesh), j.data));
+        while (!j.mesh_uploads.empty() && j.mesh_uploads.front().done()) {
+            j.mesh_uploads.pop_front();
+            add_mesh(j);
+        }
+
+        for (auto it = std::begin(j.textures); it != std::end(j.textures);) {
+            if (!it->upload.valid() && ready(it->image))
+                it->upload = uploads->texture(it->image.get());
+            if (!it->upload.valid() || !it->upload.done()) {
+                ++it;
+                continue;
+            }
+            add_texture(j, *it, it->upload.id());
+            it = j.textures.erase(it);
+        }
+    }
+
+    // makes the next mesh, uploaded in full, drawable
+    void add_mesh(job & j) {
+        auto & target = *j.target;
+        std::size_t const i = target.meshes.size();
+        target.meshes.emplace_back(std::move(j.data->meshes[i]), j.data->plan.ranges[i], j.data->plan.lods[i]);
+        auto const & mesh = target.meshes.back();
+        target.bounds.push_back(transform_bounds(mesh.bounds, target.nodes.world[mesh.node]));
+        ++target.revision;
+    }
+
+    void add_texture(job & j, pending_texture & p, unsigned id) {
+        auto & target = *j.target;
+        auto handle = texture_cache::instance().insert(p.key, id);
+        for (auto [m, t] : p.users) {
+            if (m < target.meshes.size()) {
+                target.meshes[m].textures[t].id = handle->id;
+                target.meshes[m].material.program = 0;  // resolve the bindings again
+            } else {
+                j.data->meshes[m].textures[t].id = handle->id;
+            }
+        }
+        target.textures_loaded.push_back(std::move(handle));
+        ++target.revision;
+    }
+
+    std::chrono::microseconds budget;
+    upload_thread * uploads;
+    std::shared_ptr<texture_handle> placeholder;
+    std::vector<job> jobs;
+};
+
+} // pwgl ns
+#endif
@@ -0,0 +1,491 @@
+#ifndef OBJ_IMPORTER_HPP
+#define OBJ_IMPORTER_HPP
+
+#include <glm/glm.hpp>
+
+#include "mesh_cache.hpp"
+#include "mesh_data.hpp"
+#include "mesh_optimizer.hpp"
+#include "tangent_space.hpp"
+#include "thread_pool.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Wavefront OBJ/MTL import without Assimp, for plain OBJ files (v, vt, vn,
+// f, o, g, usemtl, mtllib; anything else is skipped). The file is memory
+// mapped and cut at line boundaries into chunks parsed on the worker pool,
+// numbers go through std::from_chars. The chunks are stitched together
+// (negative indices resolved, object/material state carried over) and
+// every (object, material) pair becomes one mesh, built on the pool:
+// corners deduplicated through a hash map, normals and tangents generated
+// where the file has none (tangent_space.hpp).
+//
+// The result matches import_model() with import_flags: triangulated
+// (fan), identical vertices joined, smooth normals, flipped v, tangents.
+
+// parser internals
+namespace pwgl::detail {
+
+inline constexpr unsigned obj_none = ~0u;
+
+// one face corner, 0 based indices into the file's v / vt / vn
+struct obj_corner {
+    unsigned v;
+    unsigned vt;
+    unsigned vn;
+
+    bool operator==(obj_corner const &) const = default;
+};
+
+// object (o, g) or material (usemtl) switch at a corner of a chunk
+struct obj_event {
+    bool material;
+    std::string_view name;  // into the mapped file
+    std::size_t corner;
+};
+
+// negative index, relative to the end of the v / vt / vn of the file so
+// far; resolved once the counts of the previous chunks are known
+struct obj_relative {
+    std::size_t slot;       // corner * 3 + component
+    long long index;        // chunk relative, may reach into earlier chunks
+};
+
+struct obj_chunk {
+    char const * begin { };
+    char const * end { };
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+    std::vector<obj_corner> corners;    // 3 per triangle
+    std::vector<obj_event> events;
+    std::vector<obj_relative> relative;
+    std::vector<std::string_view> libraries;
+};
+
+inline bool obj_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+inline char const * obj_skip_space(char const * p, char const * end) {
+    while (p < end && obj_space(*p))
+        ++p;
+    return p;
+}
+
+inline std::string_view obj_rest(char const * p, char const * end) {
+    p = obj_skip_space(p, end);
+    while (end > p && obj_space(end[-1]))
+        --end;
+    return { p, static_cast<std::size_t>(end - p) };
+}
+
+// std::from_chars, plus the leading '+' it does not accept. malformed
+// numbers read as 0.
+inline char const * obj_float(char const * p, char const * end, float & value) {
+    p = obj_skip_space(p, end);
+    if (p < end && *p == '+')
+        ++p;
+    auto const [next, ec] = std::from_chars(p, end, value);
+    if (ec == std::errc())
+        return next;
+    value = 0.0f;
+    while (p < end && !obj_space(*p))
+        ++p;
+    return p;
+}
+
+// signed integer up to the next '/', blank or the end of the line
+inline char const * obj_index(char const * p, char const * end, long long & value) {
+    bool const negative = p < end && *p == '-';
+    if (negative || (p < end && *p == '+'))
+        ++p;
+    value = 0;
+    for (; p < end && static_cast<unsigned>(*p - '0') < 10; ++p)
+        value = value * 10 + (*p - '0');
+    if (negative)
+        value = -value;
+    return p;
+}
+
+inline void obj_face(obj_chunk & c, char const * p, char const * end) {
+    std::array<std::size_t, 3> const counts { c.positions.size(), c.texcoords.size(), c.normals.size() };
+    // corners of the polygon, per component
+    struct polygon_corner {
+        std::array<long long, 3> index { };
+        std::array<bool, 3> present { };
+        std::array<bool, 3> relative { };
+    };
+    thread_local std::vector<polygon_corner> polygon;
+    polygon.clear();
+
+    for (p = obj_skip_space(p, end); p < end; p = obj_skip_space(p, end)) {
+        polygon_corner corner;
+        for (std::size_t component = 0; component < 3 && p < end && !obj_space(*p); ++component) {
+            if (component && *p++ != '/')
+                break;
+            long long value = 0;
+            char const * const start = p;
+            p = obj_index(p, end, value);
+            if (p == start || value == 0)
+                continue;
+            corner.present[component] = true;
+            corner.relative[component] = value < 0;
+            corner.index[component] = value > 0 ? value - 1 : static_cast<long long>(counts[component]) + value;
+        }
+        while (p < end && !obj_space(*p))
+            ++p;
+        polygon.push_back(corner);
+    }
+
+    auto emit = [&](polygon_corner const & corner) {
+        obj_corner out { obj_none, obj_none, obj_none };
+        unsigned * components[3] { &out.v, &out.vt, &out.vn };
+        for (std::size_t i = 0; i < 3; ++i) {
+            if (!corner.present[i])
+                continue;
+            *components[i] = static_cast<unsigned>(corner.index[i]);
+            if (corner.relative[i])
+                c.relative.push_back({ c.corners.size() * 3 + i, corner.index[i] });
+        }
+        c.corners.push_back(out);
+    };
+    for (std::size_t i = 2; i < polygon.size(); ++i) {
+        emit(polygon[0]);
+        emit(polygon[i - 1]);
+        emit(polygon[i]);
+    }
+}
+
+inline void obj_line(obj_chunk & c, char const * p, char const * end) {
+    auto const keyword = [&](std::string_view word) {
+        auto const length = static_cast<std::ptrdiff_t>(word.size());
+        return end - p > length && std::string_view(p, word.size()) == word && obj_space(p[length]);
+    };
+
+    if (keyword("v")) {
+        glm::vec3 position;
+        p = obj_float(obj_float(obj_float(p + 1, end, position.x), end, position.y), end, position.z);
+        c.positions.push_back(position);
+    } else if (keyword("vt")) {
+        glm::vec2 uv { 0.0f };
+        p = obj_float(p + 2, end, uv.x);
+        if (obj_skip_space(p, end) < end)
+            obj_float(p, end, uv.y);
+        c.texcoords.emplace_back(uv.x, 1.0f - uv.y);    // aiProcess_FlipUVs
+    } else if (keyword("vn")) {
+        glm::vec3 normal;
+        obj_float(obj_float(obj_float(p + 2, end, normal.x), end, normal.y), end, normal.z);
+        c.normals.push_back(normal);
+    } else if (keyword("f")) {
+        obj_face(c, p + 1, end);
+    } else if (keyword("o") || keyword("g")) {
+        c.events.push_back({ false, obj_rest(p + 1, end), c.corners.size() });
+    } else if (keyword("usemtl")) {
+        c.events.push_back({ true, obj_rest(p + 6, end), c.corners.size() });
+    } else if (keyword("mtllib")) {
+        c.libraries.push_back(obj_rest(p + 6, end));
+    }
+}
+
+inline void obj_parse(obj_chunk & c) {
+    for (char const * p = c.begin; p < c.end;) {
+        auto const * eol = static_cast<char const *>(std::memchr(p, '\n', static_cast<std::size_t>(c.end - p)));
+        if (!eol)
+            eol = c.end;
+        char const * line_end = eol;
+        if (line_end > p && line_end[-1] == '\r')
+            --line_end;
+        obj_line(c, obj_skip_space(p, line_end), line_end);
+        p = eol + 1;
+    }
+}
+
+// textures of every material of a library, in process_mesh() order:
+// diffuse, specular, normal (map_Bump), height (map_Ka)
+inline void obj_materials(std::string const & file, std::map<std::string, std::vector<texture>, std::less<>> & materials) {
+    std::ifstream in(file);
+    if (!in) {
+        fmt::print("[-] import_obj: could not open material library: {}\n", file);
+        return;
+    }
+    constexpr std::array<std::string_view, 4> types { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+    constexpr std::array<std::pair<std::string_view, std::size_t>, 6> maps { {
+        { "map_Kd", 0 }, { "map_Ks", 1 }, { "map_Bump", 2 }, { "map_bump", 2 }, { "bump", 2 }, { "map_Ka", 3 },
+    } };
+    std::vector<texture> * current = nullptr;
+    std::array<std::string, types.size()> slots;
+    auto finish = [&] {
+        for (std::size_t i = 0; current && i < slots.size(); ++i) {
+            if (!slots[i].empty())
+                current->push_back({ 0, std::string(types[i]), slots[i] });
+        }
+        slots = { };
+    };
+
+    std::string line;
+    while (std::getline(in, line)) {
+        auto const rest = obj_rest(line.data(), line.data() + line.size());
+        auto const space = rest.find_first_of(" \t");
+        if (space == std::string_view::npos)
+            continue;
+        auto const keyword = rest.substr(0, space);
+        auto const value = obj_rest(rest.data() + space, rest.data() + rest.size());
+        if (keyword == "newmtl") {
+            finish();
+            current = &materials[std::string(value)];
+            continue;
+        }
+        // the file name is the last word, options (-bm 1, ...) come first
+        auto const last_space = value.find_last_of(" \t");
+        auto const name = last_space == std::string_view::npos ? value : value.substr(last_space + 1);
+        for (auto const & [map, slot] : maps) {
+            if (keyword == map)
+                slots[slot] = name;
+        }
+    }
+    finish();
+}
+
+// open addressing map from corner to vertex, linear probing, grows at half load
+class obj_corner_map {
+public:
+    explicit obj_corner_map(std::size_t expected) {
+        std::size_t capacity = 16;
+        while (capacity < expected * 2)
+            capacity *= 2;
+        slots.assign(capacity, { { obj_none, obj_none, obj_none }, 0 });
+    }
+
+    // vertex of corner, next if it is new
+    std::pair<unsigned, bool> insert(obj_corner const & corner, unsigned next) {
+        if ((size + 1) * 2 > slots.size())
+            grow();
+        for (std::size_t i = hash(corner) & (slots.size() - 1);; i = (i + 1) & (slots.size() - 1)) {
+            auto & s = slots[i];
+            if (s.key.v == obj_none) {
+                s = { corner, next };
+                ++size;
+                return { next, true };
+            }
+            if (s.key == corner)
+                return { s.vertex, false };
+        }
+    }
+
+private:
+    struct slot {
+        obj_corner key;
+        unsigned vertex;
+    };
+
+    static std::size_t hash(obj_corner const & c) {
+        std::uint64_t h = c.v * 0x9e3779b97f4a7c15ull;
+        h ^= (c.vt + 0x632be59bd9b4e019ull + (h << 6) + (h >> 2)) * 0xbf58476d1ce4e5b9ull;
+        h ^= (c.vn + 0x632be59bd9b4e019ull + (h << 6) + (h >> 2)) * 0x94d049bb133111ebull;
+        return static_cast<std::size_t>(h ^ (h >> 31));
+    }
+
+    void grow() {
+        auto old = std::move(slots);
+        slots.assign(old.size() * 2, { { obj_none, obj_none, obj_none }, 0 });
+        size = 0;
+        for (auto const & s : old) {
+            if (s.key.v != obj_none)
+                insert(s.key, s.vertex);
+        }
+    }
+
+    std::vector<slot> slots;
+    std::size_t size { };
+};
+
+// the stitched file: attributes of all chunks and the corner ranges of
+// one (object, material) pair
+struct obj_file {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+};
+
+struct obj_group {
+    std::string object;
+    std::string material;
+    std::vector<std::pair<obj_corner const *, obj_corner const *>> ranges;
+    std::size_t corners { };
+};
+
+inline mesh_data obj_build(obj_file const & file, obj_group const & group, std::vector<texture> const & textures, bool optimize) {
+    mesh_data mesh;
+    mesh.indices.reserve(group.corners);
+    obj_corner_map map(group.corners / 4);
+    bool normals = true;
+    bool texcoords = false;
+    for (auto [first, last] : group.ranges) {
+        for (auto const * c = first; c != last; ++c) {
+            if (c->v >= file.positions.size() || (c->vt != obj_none && c->vt >= file.texcoords.size()) ||
+                (c->vn != obj_none && c->vn >= file.normals.size()))
+                throw std::logic_error("obj: face index out of range");
+            auto const [index, inserted] = map.insert(*c, static_cast<unsigned>(mesh.vertices.size()));
+            mesh.indices.push_back(index);
+            if (!inserted)
+                continue;
+            vertex v { };
+            v.Position = file.positions[c->v];
+            if (c->vn != obj_none)
+                v.Normal = file.normals[c->vn];
+            else
+                normals = false;
+            if (c->vt != obj_none) {
+                v.TexCoords = file.texcoords[c->vt];
+                texcoords = true;
+            }
+            mesh.vertices.push_back(v);
+        }
+    }
+
+    if (!normals)
+        generate_smooth_normals(mesh);
+    // like Assimp: no tangents without texture coordinates
+    if (texcoords)
+        generate_tangents(mesh);
+    mesh.bounds = compute_bounds(mesh.vertices);
+    mesh.textures = textures;
+    if (optimize)
+        optimize_mesh(mesh);
+    return mesh;
+}
+
+} // pwgl::detail ns
+
+namespace pwgl {
+
+// mixed into the bake key (mesh_cache::cache_key) of import_obj() results
+// in place of the Assimp flags, change it when the output changes
+inline constexpr unsigned obj_import_key = 0x314a424f;  // "OBJ1"
+
+inline bool is_obj_file(std::string_view path) {
+    if (path.size() < 4)
+        return false;
+    auto const extension = path.substr(path.size() - 4);
+    return std::equal(std::begin(extension), std::end(extension), ".obj", [](char a, char b) {
+        return (a | 0x20) == b;
+    });
+}
+
+// optimize: as import_model()
+inline std::vector<mesh_data> import_obj(std::string const & path, bool optimize = true) {
+    fmt::print("import_obj: name: {}\n", path);
+    mesh_cache::mapped_file const mapped(path);
+    if (!mapped.data)
+        throw std::logic_error("could not map obj file");
+
+    // chunks of at least 1 MiB, a few per worker for balance
+    auto const * text = reinterpret_cast<char const *>(mapped.data);
+    std::size_t const count = std::clamp<std::size_t>(mapped.size >> 20, 1, workers().size() * 4);
+    std::vector<detail::obj_chunk> chunks(count);
+    char const * begin = text;
+    for (std::size_t i = 0; i < count; ++i) {
+        char const * end = text + mapped.size * (i + 1) / count;
+        if (i + 1 < count) {
+            auto const * eol = static_cast<char const *>(std::memchr(end, '\n', static_cast<std::size_t>(text + mapped.size - end)));
+            end = eol ? eol + 1 : text + mapped.size;
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = std::max(begin, end);
+        begin = chunks[i].end;
+    }
+
+    // parallel_for, not submit and wait: this may run on a worker already
+    // (model_loader), the caller has to take its share of the queue
+    workers().parallel_for(chunks.size(), 1, [&chunks](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i)
+            detail::obj_parse(chunks[i]);
+    });
+
+    // stitch: global attribute arrays, relative indices, groups
+    detail::obj_file file;
+    std::array<std::size_t, 3> base { };
+    for (auto & chunk : chunks) {
+        for (auto const & r : chunk.relative) {
+            long long const index = static_cast<long long>(base[r.slot % 3]) + r.index;
+            if (index < 0)
+                throw std::logic_error("obj: face index out of range");
+            unsigned * components[3] { &chunk.corners[r.slot / 3].v, &chunk.corners[r.slot / 3].vt, &chunk.corners[r.slot / 3].vn };
+            *components[r.slot % 3] = static_cast<unsigned>(index);
+        }
+        base[0] += chunk.positions.size();
+        base[1] += chunk.texcoords.size();
+        base[2] += chunk.normals.size();
+    }
+    file.positions.reserve(base[0]);
+    file.texcoords.reserve(base[1]);
+    file.normals.reserve(base[2]);
+
+    std::map<std::string, std::vector<texture>, std::less<>> materials;
+    std::string const directory = path.substr(0, path.find_last_of('/') + 1);
+    std::vector<detail::obj_group> groups;
+    std::map<std::pair<std::string_view, std::string_view>, std::size_t> group_index;
+    std::string_view object;
+    std::string_view material;
+    auto add_range = [&](detail::obj_chunk const & chunk, std::size_t first, std::size_t last) {
+        if (first == last)
+            return;
+        auto [it, inserted] = group_index.try_emplace({ object, material }, groups.size());
+        if (inserted)
+            groups.push_back({ std::string(object), std::string(material), { }, 0 });
+        auto & g = groups[it->second];
+        g.ranges.emplace_back(chunk.corners.data() + first, chunk.corners.data() + last);
+        g.corners += last - first;
+    };
+    for (auto & chunk : chunks) {
+        file.positions.insert(std::end(file.positions), std::begin(chunk.positions), std::end(chunk.positions));
+        file.texcoords.insert(std::end(file.texcoords), std::begin(chunk.texcoords), std::end(chunk.texcoords));
+        file.normals.insert(std::end(file.normals), std::begin(chunk.normals), std::end(chunk.normals));
+        chunk.positions = { };
+        chunk.texcoords = { };
+        chunk.normals = { };
+        for (auto library : chunk.libraries)
+            detail::obj_materials(directory + std::string(library), materials);
+
+        std::size_t first = 0;
+        for (auto const & e : chunk.events) {
+            add_range(chunk, first, e.corner);
+            first = e.corner;
+            (e.material ? material : object) = e.name;
+        }
+        add_range(chunk, first, chunk.corners.size());
+    }
+
+    std::vector<texture> const none;
+    std::vector<mesh_data> meshes(groups.size());
+    workers().parallel_for(groups.size(), 1, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+            auto const m = materials.find(groups[i].material);
+            auto const & textures = m == std::end(materials) ? none : m->second;
+            meshes[i] = detail::obj_build(file, groups[i], textures, optimize);
+        }
+    });
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        fmt::print("     import_obj: {} / {}: vertices: {}, indices: {}, textures: {}\n", groups[i].object, groups[i].material,
+                   meshes[i].vertices.size(), meshes[i].indices.size(), meshes[i].textures.size());
+    }
+    return meshes;
+}
+
+} // pwgl ns
+#endif
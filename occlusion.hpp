@@ -0,0 +1,316 @@
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+// Hierarchical depth (Hi-Z) occlusion culling, GL free. The chosen
+// occluders are rasterized into a depth buffer, the buffer is reduced into
+// a pyramid of mip levels each holding the farthest depth of the texels
+// below it, and a bounding box is occluded when its nearest depth lies
+// behind the farthest depth of the few texels covering it on the level
+// where its screen rectangle spans at most 2x2 texels.
+//
+// Depth is window depth as GL writes it, 0 on the near and 1 on the far
+// plane, rows start at the bottom. Level sizes halve rounding down like GL
+// mip levels; the last texel of a row or column folds in the extra source
+// texel of an odd sized level, so hiz.hpp builds the same pyramid on the
+// GPU and answers the same way. This is the GL 3.3 fallback and the
+// headless reference (meshtool occlusion-check).
+
+namespace pwgl {
+
+// triangles into a depth buffer, nearest depth wins. pixels are covered
+// when their center is. back faces (clockwise in window space) are skipped
+// as with GL_CULL_FACE, an open occluder seen from behind must not hide
+// anything.
+struct depth_rasterizer {
+    // empties the buffer (depth 1) and the queued triangles
+    void clear(std::uint32_t w, std::uint32_t h) {
+        width = w;
+        height = h;
+        depth.assign(std::size_t(w) * h, 1.0f);
+        triangles.clear();
+    }
+
+    // queues the triangles of indices, clip = projection * view * model
+    void draw(std::span<vertex const> vertices, std::span<unsigned const> indices, glm::mat4 const & clip) {
+        transform(vertices.size(), clip, [&](std::size_t i) { return vertices[i].Position; });
+        setup(indices);
+    }
+    void draw(std::span<glm::vec3 const> positions, std::span<unsigned const> indices, glm::mat4 const & clip) {
+        transform(positions.size(), clip, [&](std::size_t i) { return positions[i]; });
+        setup(indices);
+    }
+
+    // rasterizes the queued triangles, rows in parallel bands
+    void resolve() {
+        workers().parallel_for(height, 8, [&](std::size_t begin, std::size_t end) {
+            for (auto const & t : triangles)
+                rasterize(t, static_cast<int>(begin), static_cast<int>(end));
+        });
+        triangles.clear();
+    }
+
+    std::size_t queued() const {
+        return triangles.size();
+    }
+
+    std::uint32_t width { };
+    std::uint32_t height { };
+    std::vector<float> depth;   // width * height, row major
+    bool cull_back_faces { true };
+
+private:
+    // screen space triangle: x, y in pixels, z window depth; its pixel
+    // bounds (inclusive)
+    struct triangle {
+        std::array<glm::vec3, 3> v;
+        int x0, y0, x1, y1;
+    };
+
+    template <typename Position>
+    void transform(std::size_t count, glm::mat4 const & clip, Position const & position) {
+        transformed.resize(count);
+        workers().parallel_for(count, 16384, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i)
+                transformed[i] = clip * glm::vec4(position(i), 1.0f);
+        });
+    }
+
+    void setup(std::span<unsigned const> indices) {
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+            clip_near(transformed[indices[i]], transformed[indices[i + 1]], transformed[indices[i + 2]]);
+    }
+
+    // the part of the triangle in front of the near plane (z >= -w), the
+    // other planes are left to the pixel bounds
+    void clip_near(glm::vec4 a, glm::vec4 b, glm::vec4 c) {
+        std::array<glm::vec4, 3> const in { a, b, c };
+        std::array<glm::vec4, 4> out;
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < 3; ++i) {
+            glm::vec4 const & p = in[i];
+            glm::vec4 const & q = in[(i + 1) % 3];
+            float const dp = p.z + p.w;
+            float const dq = q.z + q.w;
+            if (dp >= 0.0f)
+                out[n++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f))
+                out[n++] = p + (q - p) * (dp / (dp - dq));
+        }
+        for (std::size_t i = 2; i < n; ++i)
+            emit(project(out[0]), project(out[i - 1]), project(out[i]));
+    }
+
+    glm::vec3 project(glm::vec4 p) const {
+        // w > 0 after near clipping unless the near plane passes through
+        // the eye
+        float const w = std::max(p.w, std::numeric_limits<float>::min());
+        return { (p.x / w * 0.5f + 0.5f) * float(width), (p.y / w * 0.5f + 0.5f) * float(height), p.z / w * 0.5f + 0.5f };
+    }
+
+    void emit(glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+        glm::vec3 const lo = glm::min(a, glm::min(b, c));
+        glm::vec3 const hi = glm::max(a, glm::max(b, c));
+        // pixels whose centers may be inside
+        float const x0 = std::max(std::ceil(lo.x - 0.5f), 0.0f);
+        float const y0 = std::max(std::ceil(lo.y - 0.5f), 0.0f);
+        float const x1 = std::min(std::floor(hi.x - 0.5f), float(width) - 1.0f);
+        float const y1 = std::min(std::floor(hi.y - 0.5f), float(height) - 1.0f);
+        if (x0 > x1 || y0 > y1 || lo.z > 1.0f)
+            return;
+        triangles.push_back({ { a, b, c }, int(x0), int(y0), int(x1), int(y1) });
+    }
+
+    void rasterize(triangle const & t, int row_begin, int row_end) {
+        int const y0 = std::max(t.y0, row_begin);
+        int const y1 = std::min(t.y1, row_end - 1);
+        if (y0 > y1)
+            return;
+        auto const & [a, b, c] = t.v;
+        float const area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (area == 0.0f || (cull_back_faces && area < 0.0f))
+            return;
+        // edge functions facing inward for either winding
+        float const s = area > 0.0f ? 1.0f : -1.0f;
+        std::array<glm::vec3, 3> const from { b, c, a };
+        std::array<glm::vec3, 3> const to { c, a, b };
+        std::array<float, 3> step_x, step_y, origin;
+        for (std::size_t e = 0; e < 3; ++e) {
+            step_x[e] = -s * (to[e].y - from[e].y);
+            step_y[e] = s * (to[e].x - from[e].x);
+            origin[e] = s * ((to[e].x - from[e].x) * (0.5f - from[e].y) - (to[e].y - from[e].y) * (0.5f - from[e].x));
+        }
+        // depth plane through the vertices, e0 weighs a
+        float const inverse_area = 1.0f / (s * area);
+        float const dz_x = (step_x[0] * a.z + step_x[1] * b.z + step_x[2] * c.z) * inverse_area;
+        float const dz_y = (step_y[0] * a.z + step_y[1] * b.z + step_y[2] * c.z) * inverse_area;
+        float const z_origin = (origin[0] * a.z + origin[1] * b.z + origin[2] * c.z) * inverse_area;
+
+        for (int y = y0; y <= y1; ++y) {
+            float const fy = float(y);
+            float e0 = origin[0] + step_y[0] * fy + step_x[0] * float(t.x0);
+            float e1 = origin[1] + step_y[1] * fy + step_x[1] * float(t.x0);
+            float e2 = origin[2] + step_y[2] * fy + step_x[2] * float(t.x0);
+            float z = z_origin + dz_y * fy + dz_x * float(t.x0);
+            float * row = depth.data() + std::size_t(y) * width;
+            for (int x = t.x0; x <= t.x1; ++x) {
+                if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f && z < row[x])
+                    row[x] = std::max(z, 0.0f);
+                e0 += step_x[0];
+                e1 += step_x[1];
+                e2 += step_x[2];
+                z += dz_x;
+            }
+        }
+    }
+
+    std::vector<glm::vec4> transformed;     // clip space vertices of the current draw()
+    std::vector<triangle> triangles;        // queued for resolve()
+};
+
+// farthest depth mip chain of a depth buffer
+struct depth_pyramid {
+    struct level {
+        std::uint32_t width { };
+        std::uint32_t height { };
+        std::vector<float> depth;
+    };
+
+    void build(std::uint32_t width, std::uint32_t height, std::span<float const> depth) {
+        std::size_t count = 1;
+        for (std::uint32_t n = std::max(width, height); n > 1; n /= 2)
+            ++count;
+        levels.resize(count);
+        levels[0].width = width;
+        levels[0].height = height;
+        levels[0].depth.assign(depth.begin(), depth.end());
+        for (std::size_t l = 1; l < count; ++l) {
+            auto const & src = levels[l - 1];
+            auto & dst = levels[l];
+            dst.width = std::max(1u, src.width / 2);
+            dst.height = std::max(1u, src.height / 2);
+            dst.depth.resize(std::size_t(dst.width) * dst.height);
+            workers().parallel_for(dst.height, 16, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t y = begin; y < end; ++y)
+                    for (std::size_t x = 0; x < dst.width; ++x)
+                        dst.depth[y * dst.width + x] = reduce(src, x, y, dst.width, dst.height);
+            });
+        }
+    }
+
+    bool empty() const {
+        return levels.empty() || levels[0].depth.empty();
+    }
+
+    // whether bv (world space) is behind the pyramid's depth for
+    // view_projection. boxes crossing the near plane or off screen are not.
+    bool occluded(bounding_volume const & bv, glm::mat4 const & view_projection) const {
+        if (empty())
+            return false;
+        glm::vec3 lo(std::numeric_limits<float>::max());
+        glm::vec3 hi(-std::numeric_limits<float>::max());
+        for (int i = 0; i < 8; ++i) {
+            glm::vec4 const corner((i & 1) ? bv.max.x : bv.min.x, (i & 2) ? bv.max.y : bv.min.y, (i & 4) ? bv.max.z : bv.min.z, 1.0f);
+            glm::vec4 const p = view_projection * corner;
+            if (p.w <= 0.0f)
+                return false;
+            glm::vec3 const ndc = glm::vec3(p) / p.w;
+            lo = glm::min(lo, ndc);
+            hi = glm::max(hi, ndc);
+        }
+        float const nearest = lo.z * 0.5f + 0.5f;
+        if (nearest <= 0.0f)
+            return false;
+
+        // every pixel the rectangle touches
+        auto const & base = levels[0];
+        float const fx0 = std::floor((lo.x * 0.5f + 0.5f) * float(base.width));
+        float const fy0 = std::floor((lo.y * 0.5f + 0.5f) * float(base.height));
+        float const fx1 = std::floor((hi.x * 0.5f + 0.5f) * float(base.width));
+        float const fy1 = std::floor((hi.y * 0.5f + 0.5f) * float(base.height));
+        if (fx1 < 0.0f || fy1 < 0.0f || fx0 >= float(base.width) || fy0 >= float(base.height))
+            return false;
+        auto const x0 = static_cast<std::uint32_t>(std::max(fx0, 0.0f));
+        auto const y0 = static_cast<std::uint32_t>(std::max(fy0, 0.0f));
+        auto const x1 = static_cast<std::uint32_t>(std::min(fx1, float(base.width) - 1.0f));
+        auto const y1 = static_cast<std::uint32_t>(std::min(fy1, float(base.height) - 1.0f));
+
+        std::size_t l = 0;
+        while (l + 1 < levels.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1))
+            ++l;
+        auto const & mip = levels[l];
+        float farthest = 0.0f;
+        for (std::uint32_t y = std::min(y0 >> l, mip.height - 1); y <= std::min(y1 >> l, mip.height - 1); ++y)
+            for (std::uint32_t x = std::min(x0 >> l, mip.width - 1); x <= std::min(x1 >> l, mip.width - 1); ++x)
+                farthest = std::max(farthest, mip.depth[std::size_t(y) * mip.width + x]);
+        return nearest > farthest;
+    }
+
+    std::vector<level> levels;  // levels[0] is the depth buffer
+private:
+    // texel (x, y) of a level width x height from its source level: the
+    // 2x2 below it, plus the odd row / column at the edge
+    static float reduce(level const & src, std::size_t x, std::size_t y, std::size_t width, std::size_t height) {
+        std::size_t const sx1 = std::min<std::size_t>(x == width - 1 ? src.width - 1 : 2 * x + 1, src.width - 1);
+        std::size_t const sy1 = std::min<std::size_t>(y == height - 1 ? src.height - 1 : 2 * y + 1, src.height - 1);
+        float d = 0.0f;
+        for (std::size_t sy = 2 * y; sy <= sy1; ++sy)
+            for (std::size_t sx = 2 * x; sx <= sx1; ++sx)
+                d = std::max(d, src.depth[sy * src.width + sx]);
+        return d;
+    }
+};
+
+// CPU path: software rasterized occluders, boxes tested in parallel
+struct occlusion_culler {
+    // starts the occluder pass of a frame, width x height pixels
+    void begin(std::uint32_t width, std::uint32_t height, glm::mat4 const & vp) {
+        view_projection = vp;
+        raster.clear(width, height);
+    }
+
+    // model: the occluder's model (or mesh) matrix
+    void add_occluder(std::span<vertex const> vertices, std::span<unsigned const> indices, glm::mat4 const & model) {
+        raster.draw(vertices, indices, view_projection * model);
+    }
+
+    // rasterizes the occluders and builds the pyramid
+    void end() {
+        raster.resolve();
+        pyramid.build(raster.width, raster.height, raster.depth);
+    }
+
+    bool occluded(bounding_volume const & bv) const {
+        return pyramid.occluded(bv, view_projection);
+    }
+
+    // clears visible[i] for the occluded boxes, leaves the others as they are
+    void cull(std::span<bounding_volume const> boxes, std::vector<std::uint8_t> & visible) const {
+        visible.resize(boxes.size(), 1);
+        workers().parallel_for(boxes.size(), 1024, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i)
+                if (visible[i] && occluded(boxes[i]))
+                    visible[i] = 0;
+        });
+    }
+
+    glm::mat4 view_projection { 1.0f };
+    depth_rasterizer raster;
+    depth_pyramid pyramid;
+};
+
+} // pwgl ns
+#endif
@@ -115,7 +115,8 @@ unsigned compile_shader(unsigned type, std::string const & source)
     return id;
 }
 
-shader create_shader(std::string const & vertex_source, std::string const & fragment_source)
+shader create_shader(std::string const & vertex_source, std::string const & fragment_source,
+                     std::span<char const * const> feedback_varyings)
 {
     unsigned vs = compile_shader(GL_VERTEX_SHADER, vertex_source);
     if (!vs) {
@@ -131,6 +132,10 @@ shader create_shader(std::string const & vertex_source, std::string const & frag
     unsigned const program = glCreateProgram();
     glAttachShader(program, vs);
     glAttachShader(program, fs);
+    // captured by transform feedback, has to be set before linking
+    if (!feedback_varyings.empty())
+        glTransformFeedbackVaryings(program, static_cast<GLsizei>(feedback_varyings.size()), feedback_varyings.data(),
+                                    GL_INTERLEAVED_ATTRIBS);
 
     fmt::print("[~] linking shader program\n");
     glLinkProgram(program);
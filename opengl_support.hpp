@@ -12,6 +12,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp> // make_mat
 
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -83,10 +84,10 @@ struct gls {
         //pwgl::print_glinfo();
 
 
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_LESS);
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
+        pwgl::gl().enable(GL_DEPTH_TEST);
+        pwgl::gl().depth_func(GL_LESS);
+        pwgl::gl().enable(GL_CULL_FACE);
+        pwgl::gl().cull_face(GL_BACK);
         glFrontFace(GL_CCW);
     }
 
@@ -111,7 +112,10 @@ struct gls {
 
 // prototypes:
 unsigned compile_shader(unsigned type, std::string const & source);
-shader create_shader(std::string const & vertex_source, std::string const & fragment_source);
+// feedback_varyings: vertex shader outputs captured by transform feedback,
+// interleaved
+shader create_shader(std::string const & vertex_source, std::string const & fragment_source,
+                     std::span<char const * const> feedback_varyings = {});
 std::map<std::string, std::stringstream> parse_shaders(std::string const filename);
 
 } // pwgl ns.
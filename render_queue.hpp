@@ -0,0 +1,194 @@
+#ifndef RENDER_QUEUE_HPP
+#define RENDER_QUEUE_HPP
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "frame_stats.hpp"
+#include "frustum.hpp"
+#include "gl_state.hpp"
+#include "lod_selection.hpp"
+#include "model.hpp"
+#include "shader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Draws are recorded as render_items during the frame and executed in the
+// order of a 64 bit sort key:
+//
+//   pass (4) | program (12) | material (16) | vao (12) | depth (20)
+//
+// program and vao are dense ids assigned by the queue, material is the GL
+// name of the first (diffuse) texture and depth the upper bits of the view
+// space distance, front to back for opaque and back to front for
+// transparent passes. The keys are radix sorted and executed through
+// gl_state, which skips the binds that would not change anything.
+
+namespace pwgl {
+
+enum class render_pass : std::uint8_t {
+    opaque,
+    transparent,
+};
+
+// one indexed draw. the material and the shader must outlive execute().
+struct render_item {
+    pwgl::shader const * shader { };
+    unsigned vao { };
+    mesh_range range;
+    material_binding const * material { };  // null: no textures
+    uniform_handle model_u;
+    glm::mat4 model { 1.0f };
+    uniform_handle vertex_packed_u;
+    int vertex_packed { };
+};
+
+struct render_queue {
+    void submit(render_item const & item, float depth, render_pass pass = render_pass::opaque) {
+        entries.push_back({ sort_key(item, depth, pass), static_cast<std::uint32_t>(items.size()) });
+        items.push_back(item);
+    }
+
+    // queues the meshes of model that intersect the view frustum, each with
+    // transform times its node's world matrix. with lods
+    // every mesh is drawn at the level select_lod() picks for it, the level
+    // of the previous submit with the same instance id giving the
+    // hysteresis. instance: a stable id of the model instance (a scene
+    // node, an instance index), not its position in this frame's list.
+    void submit(pwgl::model & model, pwgl::shader const & shader, uniform_handle model_u, glm::mat4 const & transform,
+                glm::mat4 const & view, glm::mat4 const & projection, render_pass pass = render_pass::opaque,
+                lod_policy const * lods = nullptr, std::uint32_t instance = 0) {
+        glm::mat4 const model_view = view * transform;
+        pwgl::cull_boxes(pwgl::frustum::from(projection * model_view), model.bounds, visible);
+
+        render_item item;
+        item.shader = &shader;
+        item.vao = model.arena.vao;
+        item.model_u = model_u;
+        item.vertex_packed_u = shader.uniform("vertex_packed");
+        item.vertex_packed = model.arena.format == vertex_format::packed ? 1 : 0;
+        for (std::size_t i = 0; i < model.meshes.size(); ++i) {
+            if (!visible[i])
+                continue;
+            auto & mesh = model.meshes[i];
+            if (mesh.material.program != shader.id)
+                mesh.bind_material(shader);
+            item.model = model.mesh_transform(i, transform);
+            item.range = mesh.range;
+            if (lods) {
+                if (mesh.instance_lods.size() <= instance)
+                    mesh.instance_lods.resize(instance + std::size_t(1), 0);
+                auto & level = mesh.instance_lods[instance];
+                level = static_cast<std::uint8_t>(select_lod(mesh.lod_errors, mesh.bounds, item.model, *lods, level));
+                item.range = mesh.lod_range(level);
+            }
+            item.material = &mesh.material;
+            glm::vec4 const center = view * item.model * glm::vec4(mesh.bounds.center, 1.0f);
+            submit(item, -center.z, pass);
+        }
+    }
+
+    // sorts and draws everything submitted since the last execute()
+    void execute() {
+        sort();
+
+        // vertex_packed is set by other draw paths too, so only trust the
+        // value this execute() has set
+        unsigned packed_program = gl_state::unknown;
+        int packed = -1;
+        for (auto const & entry : entries) {
+            auto const & item = items[entry.item];
+            gl().use_program(item.shader->id);
+            gl().bind_vertex_array(item.vao);
+            if (item.vertex_packed_u.location >= 0 && (packed_program != item.shader->id || packed != item.vertex_packed)) {
+                item.shader->set(item.vertex_packed_u, item.vertex_packed);
+                packed_program = item.shader->id;
+                packed = item.vertex_packed;
+            }
+
+            if (item.material) {
+                auto const & material = *item.material;
+                for (std::size_t i = 0; i < material.count; ++i)
+                    gl().bind_texture(static_cast<unsigned>(material.slots[i].unit), material.slots[i].texture);
+                if (material.position_scale.location >= 0) {
+                    item.shader->set(material.position_offset, item.range.position_offset);
+                    item.shader->set(material.position_scale, item.range.position_scale);
+                }
+            }
+            if (item.model_u.location >= 0)
+                item.shader->set(item.model_u, item.model);
+            vertex_arena::draw(item.range);
+        }
+
+        // keep the capacity, steady state frames do not allocate
+        entries.clear();
+        items.clear();
+    }
+
+private:
+    struct queue_entry {
+        std::uint64_t key;
+        std::uint32_t item;
+    };
+
+    std::uint16_t dense_id(std::vector<unsigned> & names, unsigned name) {
+        auto it = std::find(std::begin(names), std::end(names), name);
+        if (it == std::end(names))
+            it = names.insert(it, name);
+        return static_cast<std::uint16_t>(it - std::begin(names));
+    }
+
+    std::uint64_t sort_key(render_item const & item, float depth, render_pass pass) {
+        // the bit pattern of a non negative float increases with its value
+        std::uint32_t d = std::bit_cast<std::uint32_t>(std::max(depth, 0.0f)) >> 11;
+        if (pass == render_pass::transparent)
+            d = ~d;
+        std::uint64_t const material = item.material && item.material->count ? item.material->slots[0].texture : 0;
+        return std::uint64_t(pass) << 60
+             | std::uint64_t(dense_id(programs, item.shader->id) & 0xfff) << 48
+             | (material & 0xffff) << 32
+             | std::uint64_t(dense_id(vaos, item.vao) & 0xfff) << 20
+             | (d & 0xfffff);
+    }
+
+    // least significant digit first, 8 bits per pass. digits shared by every
+    // key are skipped, so the usual frame with few programs and vaos takes
+    // far fewer than 8 passes.
+    void sort() {
+        std::array<std::array<std::size_t, 256>, 8> counts { };
+        for (auto const & e : entries) {
+            for (std::size_t digit = 0; digit < 8; ++digit)
+                ++counts[digit][(e.key >> (digit * 8)) & 0xff];
+        }
+
+        scratch.resize(entries.size());
+        for (std::size_t digit = 0; digit < 8; ++digit) {
+            auto & count = counts[digit];
+            if (entries.empty() || count[(entries.front().key >> (digit * 8)) & 0xff] == entries.size())
+                continue;
+
+            std::size_t offset = 0;
+            for (auto & c : count)
+                offset += std::exchange(c, offset);
+            for (auto const & e : entries)
+                scratch[count[(e.key >> (digit * 8)) & 0xff]++] = e;
+            std::swap(entries, scratch);
+        }
+    }
+
+    std::vector<render_item> items;
+    std::vector<queue_entry> entries;
+    std::vector<queue_entry> scratch;
+    std::vector<unsigned> programs;
+    std::vector<unsigned> vaos;
+    std::vector<std::uint8_t> visible;
+};
+
+} // pwgl ns
+#endif
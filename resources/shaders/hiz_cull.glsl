@@ -0,0 +1,73 @@
+#shader vertex
+
+#version 330 core
+// one point per box, world space (pwgl::bounding_volume min / max)
+layout (location = 0) in vec3 box_min;
+layout (location = 1) in vec3 box_max;
+
+uniform mat4 view_projection;
+uniform sampler2D hiz;
+uniform int levels;
+
+// captured by transform feedback, 1 visible, 0 occluded
+flat out int visible;
+
+// pwgl::depth_pyramid::occluded
+bool occluded()
+{
+    vec3 lo = vec3(3.4e38f);
+    vec3 hi = vec3(-3.4e38f);
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = vec3((i & 1) != 0 ? box_max.x : box_min.x,
+                           (i & 2) != 0 ? box_max.y : box_min.y,
+                           (i & 4) != 0 ? box_max.z : box_min.z);
+        vec4 p = view_projection * vec4(corner, 1.0f);
+        if (p.w <= 0.0f)
+            return false;
+        vec3 ndc = p.xyz / p.w;
+        lo = min(lo, ndc);
+        hi = max(hi, ndc);
+    }
+    float nearest = lo.z * 0.5f + 0.5f;
+    if (nearest <= 0.0f)
+        return false;
+
+    // every pixel the rectangle touches
+    ivec2 size = textureSize(hiz, 0);
+    vec2 f0 = floor((lo.xy * 0.5f + 0.5f) * vec2(size));
+    vec2 f1 = floor((hi.xy * 0.5f + 0.5f) * vec2(size));
+    if (any(lessThan(f1, vec2(0.0f))) || any(greaterThanEqual(f0, vec2(size))))
+        return false;
+    ivec2 p0 = ivec2(max(f0, vec2(0.0f)));
+    ivec2 p1 = ivec2(min(f1, vec2(size - 1)));
+
+    int l = 0;
+    while (l + 1 < levels && ((p1.x >> l) - (p0.x >> l) > 1 || (p1.y >> l) - (p0.y >> l) > 1))
+        ++l;
+    ivec2 last = textureSize(hiz, l) - 1;
+    ivec2 t0 = min(p0 >> l, last);
+    ivec2 t1 = min(p1 >> l, last);
+    float farthest = 0.0f;
+    for (int y = t0.y; y <= t1.y; ++y)
+        for (int x = t0.x; x <= t1.x; ++x)
+            farthest = max(farthest, texelFetch(hiz, ivec2(x, y), l).r);
+    return nearest > farthest;
+}
+
+void main()
+{
+    visible = occluded() ? 0 : 1;
+    gl_Position = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+//------------------------------------------------------------------------------
+#shader fragment
+
+#version 330 core
+out vec4 color;
+
+// never runs, the pass is drawn with GL_RASTERIZER_DISCARD
+void main()
+{
+    color = vec4(1.0f);
+}
@@ -0,0 +1,37 @@
+#shader vertex
+
+#version 330 core
+
+// full screen triangle, see pwgl::hiz_culler
+void main()
+{
+    vec2 position = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID & 2) * 2 - 1);
+    gl_Position = vec4(position, 0.0f, 1.0f);
+}
+
+//------------------------------------------------------------------------------
+#shader fragment
+
+#version 330 core
+
+// the previous level, the texture's only level visible while this one is drawn
+uniform sampler2D depth;
+uniform ivec2 previous_size;
+
+// farthest depth of the 2x2 texels below, plus the odd row / column at the
+// edge (pwgl::depth_pyramid::reduce)
+void main()
+{
+    ivec2 size = max(previous_size / 2, ivec2(1));
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    ivec2 first = texel * 2;
+    ivec2 last = ivec2(texel.x == size.x - 1 ? previous_size.x - 1 : first.x + 1,
+                       texel.y == size.y - 1 ? previous_size.y - 1 : first.y + 1);
+    last = min(last, previous_size - 1);
+
+    float farthest = 0.0f;
+    for (int y = first.y; y <= last.y; ++y)
+        for (int x = first.x; x <= last.x; ++x)
+            farthest = max(farthest, texelFetch(depth, ivec2(x, y), 0).r);
+    gl_FragDepth = farthest;
+}
@@ -4,12 +4,20 @@
 in vec3 position;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// pwgl::frame_uniforms, see frame_uniforms.hpp
+layout (std140) uniform frame {
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec3 camera_position;
+    float time;
+    vec4 viewport;
+};
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f);
+    gl_Position = view_projection * model * vec4(position, 1.0f);
 }
 
 //------------------------------------------------------------------------------
@@ -1,23 +1,62 @@
 #shader vertex
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec4 aPos;        // packed: snorm xyz, w: tangent handedness
+layout (location = 1) in vec3 aNormal;     // packed: octahedral xy
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aInstanceModel;  // 5..8, pwgl::model::draw_instanced
+layout (location = 9) in vec4 aInstanceColor;
 
 out vec2 TexCoords;
 out vec3 vs_position;
 out vec3 vs_normal;
+out vec4 vs_color;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform int instanced;
+
+// pwgl::frame_uniforms, see frame_uniforms.hpp
+layout (std140) uniform frame {
+    mat4 view;
+    mat4 projection;
+    mat4 view_projection;
+    vec3 camera_position;
+    float time;
+    vec4 viewport;
+};
+
+// pwgl::vertex_format::packed, see vertex_packing.hpp
+uniform int vertex_packed;
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    if (n.z < 0.0f)
+        n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    return normalize(n);
+}
 
 void main()
 {
+    vec3 position = aPos.xyz;
+    vec3 normal = aNormal;
+    if (vertex_packed != 0) {
+        position = position_offset + position_scale * aPos.xyz;
+        normal = oct_decode(aNormal.xy);
+    }
+
+    mat4 world = model;
+    vs_color = vec4(1.0f);
+    if (instanced != 0) {
+        world = aInstanceModel;
+        vs_color = aInstanceColor;
+    }
+
     TexCoords = aTexCoords;
-    vs_position = vec4(model * vec4(aPos, 1.0f)).xyz;
-    vs_normal = mat3(1.0f) * aNormal;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vs_position = vec4(world * vec4(position, 1.0f)).xyz;
+    vs_normal = mat3(1.0f) * normal;
+    gl_Position = view_projection * world * vec4(position, 1.0);
 }
 
 //------------------------------------------------------------------------------
@@ -28,6 +67,7 @@ out vec4 FragColor;
 
 in vec3 vs_position;
 in vec3 vs_normal;
+in vec4 vs_color;
 in vec2 TexCoords;
 
 uniform sampler2D texture_diffuse1;
@@ -48,6 +88,6 @@ void main()
 
     //FragColor = texture(texture_diffuse1, TexCoords) * vec4(ambientLight, 1.0f);// + vec4(diffuseFinal, 1);
     //vec4 texture_col = 
-    FragColor = texture(texture_diffuse1, TexCoords) * vec4(diffuseFinal, 1);
+    FragColor = texture(texture_diffuse1, TexCoords) * vec4(diffuseFinal, 1) * vs_color;
 }
 
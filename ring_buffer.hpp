@@ -0,0 +1,164 @@
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <GL/glew.h>
+
+#include "frame_stats.hpp"
+
+#include "fmt/format.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+// Streaming buffer for data written every frame (instance transforms,
+// uniform blocks, debug geometry). The buffer is split into one region
+// per frame in flight; a frame allocates linearly from its region and
+// fences it at end_frame(). begin_frame() waits for the fence of the
+// region it is about to reuse, the wait is reported as
+// frame_stats::fence_wait_ms.
+//
+// GL 4.4 / ARB_buffer_storage: the buffer is persistently and coherently
+// mapped, allocations are written in place. Otherwise allocations go to
+// a CPU staging copy, the storage is orphaned every frame and flush()
+// uploads the staged bytes with glBufferSubData.
+//
+// Usage per frame: begin_frame(), allocate() + write, flush() before the
+// draws reading the data, end_frame() after the last of them.
+
+namespace pwgl {
+
+struct ring_buffer {
+    static constexpr std::size_t frames = 3;
+
+    struct allocation {
+        void * data;
+        std::size_t offset;     // in bytes from the start of buffer
+    };
+
+    explicit ring_buffer(std::size_t frame_size)
+        : region(frame_size)
+        , persistent(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+    {
+        glGenBuffers(1, &buffer);
+        // not a pwgl::gl_state tracked target, so the shadow stays valid
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        if (persistent) {
+            GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            auto const size = static_cast<GLsizeiptr>(region * frames);
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+            mapped = static_cast<std::uint8_t *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+            if (!mapped)
+                throw std::logic_error("could not map the ring buffer");
+        } else {
+            glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(region), nullptr, GL_STREAM_DRAW);
+            staging.resize(region);
+        }
+        fmt::print("[~] ring_buffer: {} x {} KiB, {}\n", persistent ? frames : 1, region / 1024,
+                   persistent ? "persistent mapping" : "orphaning");
+    }
+    ring_buffer(ring_buffer const &) = delete;
+    ring_buffer & operator=(ring_buffer const &) = delete;
+    ~ring_buffer() {
+        for (auto & fence : fences) {
+            if (fence)
+                glDeleteSync(fence);
+        }
+        if (mapped) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    void begin_frame() {
+        head = 0;
+        flushed = 0;
+        if (!persistent) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(region), nullptr, GL_STREAM_DRAW);
+            return;
+        }
+
+        auto & fence = fences[current];
+        if (!fence)
+            return;
+        auto const start = std::chrono::steady_clock::now();
+        GLbitfield flags = 0;
+        for (;;) {
+            GLenum const result = glClientWaitSync(fence, flags, 1'000'000);   // 1 ms
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+                break;
+            flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        }
+        stats().fence_wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    // bytes of the current frame's region, offset aligned to alignment
+    allocation allocate(std::size_t bytes, std::size_t alignment = 16) {
+        std::size_t const offset = (head + alignment - 1) / alignment * alignment;
+        if (offset + bytes > region)
+            throw std::logic_error("ring buffer frame region exhausted");
+        head = offset + bytes;
+
+        if (persistent)
+            return { mapped + base() + offset, base() + offset };
+        return { staging.data() + offset, offset };
+    }
+
+    // bytes an allocate() at alignment can still take from the current
+    // frame's region
+    std::size_t available(std::size_t alignment = 16) const {
+        std::size_t const offset = (head + alignment - 1) / alignment * alignment;
+        return offset < region ? region - offset : 0;
+    }
+
+    allocation write(void const * data, std::size_t bytes, std::size_t alignment = 16) {
+        auto a = allocate(bytes, alignment);
+        std::memcpy(a.data, data, bytes);
+        return a;
+    }
+
+    // makes the allocations since the last flush visible to GL
+    void flush() {
+        if (persistent || flushed == head)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(flushed), static_cast<GLsizeiptr>(head - flushed),
+                        staging.data() + flushed);
+        flushed = head;
+    }
+
+    void end_frame() {
+        flush();
+        if (!persistent)
+            return;
+        fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        current = (current + 1) % frames;
+    }
+
+    unsigned buffer { };
+
+private:
+    std::size_t base() const {
+        return current * region;
+    }
+
+    std::size_t region;
+    bool persistent;
+    std::uint8_t * mapped { };
+    std::vector<std::uint8_t> staging;
+    std::array<GLsync, frames> fences { };
+    std::size_t current { };
+    std::size_t head { };
+    std::size_t flushed { };
+};
+
+} // pwgl ns
+#endif
@@ -0,0 +1,259 @@
+#ifndef SCENE_GRAPH_HPP
+#define SCENE_GRAPH_HPP
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "mesh_data.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Transform hierarchy, GL free. Nodes live in flat arrays (structure of
+// arrays) in topological order, every parent before its children, and are
+// addressed by index. The setters only record the change; update()
+// recomputes the world matrices of the changed nodes and everything below
+// them, nothing else.
+//
+// While nodes are added depth first (as the import and most scene setup
+// does) the order is a pre-order: the subtree of node i is the contiguous
+// range [i, subtree_end[i]), and update() walks only those ranges. Adding
+// a child to a node whose subtree is not at the end of the arrays breaks
+// that; update() then scans from the first changed node instead, which is
+// still correct but touches every later node.
+
+namespace pwgl {
+
+namespace detail {
+
+// out = a * b, column major 4x4. out may not alias a or b.
+inline void multiply(glm::mat4 const & a, glm::mat4 const & b, glm::mat4 & out) {
+    float const * pa = &a[0][0];
+    float const * pb = &b[0][0];
+    float * po = &out[0][0];
+#if defined(__AVX__)
+    // two result columns per register, the scalars of b broadcast per lane
+    __m256 const a0 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(pa + 0));
+    __m256 const a1 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(pa + 4));
+    __m256 const a2 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(pa + 8));
+    __m256 const a3 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(pa + 12));
+    for (int c = 0; c < 16; c += 8) {
+        __m256 const bc = _mm256_loadu_ps(pb + c);
+        __m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bc, 0x00));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bc, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bc, 0xaa)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bc, 0xff)));
+        _mm256_storeu_ps(po + c, r);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    __m128 const a0 = _mm_loadu_ps(pa + 0), a1 = _mm_loadu_ps(pa + 4), a2 = _mm_loadu_ps(pa + 8), a3 = _mm_loadu_ps(pa + 12);
+    for (int c = 0; c < 16; c += 4) {
+        __m128 const bc = _mm_loadu_ps(pb + c);
+        __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, 0x00));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, 0x55)));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, 0xaa)));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(bc, bc, 0xff)));
+        _mm_storeu_ps(po + c, r);
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t const a0 = vld1q_f32(pa + 0), a1 = vld1q_f32(pa + 4), a2 = vld1q_f32(pa + 8), a3 = vld1q_f32(pa + 12);
+    for (int c = 0; c < 16; c += 4) {
+        float32x4_t const bc = vld1q_f32(pb + c);
+        float32x4_t r = vmulq_n_f32(a0, vgetq_lane_f32(bc, 0));
+        r = vmlaq_n_f32(r, a1, vgetq_lane_f32(bc, 1));
+        r = vmlaq_n_f32(r, a2, vgetq_lane_f32(bc, 2));
+        r = vmlaq_n_f32(r, a3, vgetq_lane_f32(bc, 3));
+        vst1q_f32(po + c, r);
+    }
+#else
+    for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 4; ++r)
+            po[c * 4 + r] = pa[r] * pb[c * 4] + pa[4 + r] * pb[c * 4 + 1] + pa[8 + r] * pb[c * 4 + 2] + pa[12 + r] * pb[c * 4 + 3];
+#endif
+}
+
+// translation * rotation * scale
+inline glm::mat4 compose(glm::vec3 t, glm::quat q, glm::vec3 s) {
+    float const xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float const xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float const wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    glm::mat4 m;
+    m[0] = glm::vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * s.x;
+    m[1] = glm::vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * s.y;
+    m[2] = glm::vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * s.z;
+    m[3] = glm::vec4(t, 1.0f);
+    return m;
+}
+
+} // detail ns
+
+struct scene_graph {
+    scene_graph() = default;
+
+    // from an import (node_data, parents first)
+    explicit scene_graph(std::span<node_data const> nodes) {
+        reserve(nodes.size());
+        for (auto const & n : nodes)
+            add(n.parent, n.translation, n.rotation, n.scale);
+    }
+
+    void reserve(std::size_t n) {
+        parent.reserve(n);
+        subtree_end.reserve(n);
+        translation.reserve(n);
+        rotation.reserve(n);
+        scale.reserve(n);
+        local.reserve(n);
+        world.reserve(n);
+        dirty.reserve(n);
+    }
+
+    // appends a node below parent (no_node: a root), returns its index.
+    // parent has to exist already.
+    std::uint32_t add(std::uint32_t parent_node = no_node, glm::vec3 t = glm::vec3(0.0f),
+                      glm::quat r = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3 s = glm::vec3(1.0f)) {
+        auto const i = static_cast<std::uint32_t>(parent.size());
+        parent.push_back(parent_node);
+        subtree_end.push_back(i + 1);
+        translation.push_back(t);
+        rotation.push_back(r);
+        scale.push_back(s);
+        local.push_back(detail::compose(t, r, s));
+        world.emplace_back(1.0f);
+        dirty.push_back(0);
+        mark(i);
+
+        // a child extends the subtree of every ancestor, which stays
+        // contiguous only if it ended here
+        if (parent_node != no_node && subtree_end[parent_node] != i)
+            preorder = false;
+        for (std::uint32_t a = parent_node; a != no_node; a = parent[a])
+            subtree_end[a] = i + 1;
+        return i;
+    }
+
+    std::size_t size() const {
+        return parent.size();
+    }
+
+    void set_translation(std::uint32_t i, glm::vec3 t) {
+        translation[i] = t;
+        mark(i);
+    }
+    void set_rotation(std::uint32_t i, glm::quat r) {
+        rotation[i] = r;
+        mark(i);
+    }
+    void set_scale(std::uint32_t i, glm::vec3 s) {
+        scale[i] = s;
+        mark(i);
+    }
+    void set_local(std::uint32_t i, glm::vec3 t, glm::quat r, glm::vec3 s) {
+        translation[i] = t;
+        rotation[i] = r;
+        scale[i] = s;
+        mark(i);
+    }
+
+    // brings the world matrices up to date, returns the number of nodes
+    // whose world matrix was recomputed
+    std::size_t update() {
+        if (changed.empty())
+            return 0;
+        for (std::uint32_t i : changed)
+            local[i] = detail::compose(translation[i], rotation[i], scale[i]);
+
+        std::size_t updated = 0;
+        if (changed.size() > size() / 8) {
+            // most of the graph, cheaper than sorting the changes
+            propagate_all();
+            updated = size();
+            std::fill(std::begin(dirty), std::end(dirty), std::uint8_t(0));
+        } else if (preorder) {
+            std::sort(std::begin(changed), std::end(changed));
+            // changed nodes inside an already updated subtree are covered
+            std::uint32_t covered = 0;
+            for (std::uint32_t i : changed) {
+                if (i < covered)
+                    continue;
+                covered = subtree_end[i];
+                propagate(i, covered);
+                updated += covered - i;
+            }
+            for (std::uint32_t i : changed)
+                dirty[i] = 0;
+        } else {
+            std::sort(std::begin(changed), std::end(changed));
+            // a node is dirty if it changed or its parent was recomputed
+            auto const n = static_cast<std::uint32_t>(size());
+            for (std::uint32_t i = changed.front(); i < n; ++i) {
+                std::uint32_t const p = parent[i];
+                if (!dirty[i] && (p == no_node || !dirty[p]))
+                    continue;
+                dirty[i] = 1;
+                if (p == no_node)
+                    world[i] = local[i];
+                else
+                    detail::multiply(world[p], local[i], world[i]);
+                ++updated;
+            }
+            std::fill(std::begin(dirty) + changed.front(), std::end(dirty), std::uint8_t(0));
+        }
+        changed.clear();
+        return updated;
+    }
+
+    // per node, indexed alike. written through add() and the setters only.
+    std::vector<std::uint32_t> parent;          // no_node for roots
+    std::vector<std::uint32_t> subtree_end;     // one past the last descendant, valid while preorder
+    std::vector<glm::vec3> translation;
+    std::vector<glm::quat> rotation;
+    std::vector<glm::vec3> scale;
+    std::vector<glm::mat4> local;               // translation * rotation * scale, as of the last update()
+    std::vector<glm::mat4> world;               // as of the last update()
+    std::vector<std::uint8_t> dirty;            // local transform changed since the last update()
+    bool preorder { true };
+
+private:
+    void mark(std::uint32_t i) {
+        if (dirty[i])
+            return;
+        dirty[i] = 1;
+        changed.push_back(i);
+    }
+
+    // world matrices of the pre-order range [begin, end), the parent of
+    // begin is outside and up to date
+    void propagate(std::uint32_t begin, std::uint32_t end) {
+        std::uint32_t const p = parent[begin];
+        if (p == no_node)
+            world[begin] = local[begin];
+        else
+            detail::multiply(world[p], local[begin], world[begin]);
+        for (std::uint32_t i = begin + 1; i < end; ++i)
+            detail::multiply(world[parent[i]], local[i], world[i]);
+    }
+
+    void propagate_all() {
+        for (std::size_t i = 0; i < size(); ++i) {
+            if (parent[i] == no_node)
+                world[i] = local[i];
+            else
+                detail::multiply(world[parent[i]], local[i], world[i]);
+        }
+    }
+
+    std::vector<std::uint32_t> changed;         // nodes with dirty set
+};
+
+} // pwgl ns
+#endif
@@ -12,31 +12,43 @@
 #include <glm/gtc/type_ptr.hpp> // make_mat
 
 //#include "fmt/format.h"
+#include "frame_uniforms.hpp"
+#include "gl_state.hpp"
 
+#include <bit>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 
 namespace pwgl {
 
+// resolved uniform location, obtained once through shader::uniform()
+struct uniform_handle {
+    int location { -1 };
+};
+
 struct shader {
     shader() = default;
     shader(unsigned id)
         : id(id)
-    { }
+    {
+        introspect();
+    }
     ~shader() {
         //fmt::print("~shader()\n");
         for (unsigned elt : vaos) {
             //fmt::print("[~] deleting vao: {}\n", elt);
-            glDeleteVertexArrays(1, &elt);
+            pwgl::gl().delete_vertex_array(elt);
         }
         for (unsigned elt : vbos) {
             //fmt::print("[~] deleting vbo: {}\n", elt);
-            glDeleteBuffers(1, &elt);
+            pwgl::gl().delete_buffer(elt);
         }
         for (unsigned elt : ebos) {
             //fmt::print("[~] deleting ebo: {}\n", elt);
-            glDeleteBuffers(1, &elt);
+            pwgl::gl().delete_buffer(elt);
         }
         //fmt::print("[~] deleting shader: {}\n", id);
         glDeleteProgram(id);
@@ -45,7 +57,7 @@ struct shader {
     unsigned vao_alloc() {
         unsigned vao;
         glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
+        pwgl::gl().bind_vertex_array(vao);
         vaos.emplace_back(vao);
         return vao;
     }
@@ -53,7 +65,7 @@ struct shader {
     unsigned vbo_alloc(void const * data, std::size_t size, std::string name) {
         unsigned int vbo;
         glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        pwgl::gl().bind_buffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
 
         auto const attr_id = this->getAttribute(name.c_str());
@@ -71,7 +83,7 @@ struct shader {
     {
         unsigned int ebo;
         glGenBuffers(1, &ebo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        pwgl::gl().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
         ebos.emplace_back(ebo);
         return ebo;
@@ -80,7 +92,7 @@ struct shader {
     unsigned texture_alloc(std::string path = "resources/textures/container.jpg") {
         unsigned int texture;
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        pwgl::gl().bind_texture(0, texture);
 
         // repeat:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -113,42 +125,210 @@ struct shader {
     int getAttribute(std::string const & name) const {
         return glGetAttribLocation(id, name.c_str());
     }
-    int getLocation(std::string const & name) const {
-        return glGetUniformLocation(id, name.c_str());
+    int getLocation(std::string_view name) const {
+        return uniform(name).location;
     }
-    void set(glm::vec3 v, std::string name) const {
-        glUniform3fv(this->getLocation(name), 1, &v[0]);
+
+    // lookup in the table built at link time, no allocation and no GL call
+    uniform_handle uniform(std::string_view name) const {
+        auto const * info = find(name);
+        return { info ? info->location : -1 };
+    }
+
+    // texture unit permanently assigned to a sampler uniform, -1 if the
+    // program has no such sampler. every element of a sampler array has its
+    // own unit, "name" being "name[0]"
+    int texture_unit(std::string_view name) const {
+        auto const * info = find(name);
+        return info ? info->unit : -1;
+    }
+
+    void set(uniform_handle u, glm::vec3 const & v) const {
+        glUniform3fv(u.location, 1, &v[0]);
     }
-    void set(glm::mat4 m, std::string name) const {
-        glUniformMatrix4fv(this->getLocation(name), 1, GL_FALSE, &m[0][0]);
+    void set(uniform_handle u, glm::mat4 const & m) const {
+        glUniformMatrix4fv(u.location, 1, GL_FALSE, &m[0][0]);
     }
-    void set(int i, std::string name) const {
-        glUniform1i(this->getLocation(name), i);
+    void set(uniform_handle u, int i) const {
+        glUniform1i(u.location, i);
     }
-    void set(unsigned long ul, std::string name) const {
-        glUniform1i(this->getLocation(name), ul);
+    void set(uniform_handle u, float f) const {
+        glUniform1f(u.location, f);
+    }
+
+    void set(glm::vec3 v, std::string_view name) const {
+        set(uniform(name), v);
+    }
+    void set(glm::mat4 m, std::string_view name) const {
+        set(uniform(name), m);
+    }
+    void set(int i, std::string_view name) const {
+        set(uniform(name), i);
+    }
+    void set(unsigned long ul, std::string_view name) const {
+        set(uniform(name), static_cast<int>(ul));
     }
 
     template <typename T>
     static inline constexpr bool dependent_false_v{ false };
 
     template <typename T>
-    void set(T t, std::string name) const {
-        if (std::is_integral<T>::value)
-            return glUniform1i(this->getLocation(name.c_str()), static_cast<int>(t));
-        else if (std::is_floating_point<T>::value)
-            return glUniform1f(this->getLocation(name.c_str()), t);
+    void set(T t, std::string_view name) const {
+        if constexpr (std::is_integral<T>::value)
+            return set(uniform(name), static_cast<int>(t));
+        else if constexpr (std::is_floating_point<T>::value)
+            return set(uniform(name), static_cast<float>(t));
         else
             static_assert(dependent_false_v<T>, "type unsupported");
     }
     void use() const {
-        glUseProgram(id);
+        pwgl::gl().use_program(id);
     }
 
     std::vector<unsigned> vaos;
     std::vector<unsigned> vbos;
     std::vector<unsigned> ebos;
     unsigned id { };
+
+private:
+    struct uniform_info {
+        std::string name;
+        int location;
+        unsigned type;
+        int unit;
+    };
+
+    uniform_info const * find(std::string_view name) const {
+        if (slots.empty())
+            return nullptr;
+        int const slot = slots[uniform_hash(name, seed) & (slots.size() - 1)];
+        if (slot < 0 || uniforms[static_cast<std::size_t>(slot)].name != name)
+            return nullptr;
+        return &uniforms[static_cast<std::size_t>(slot)];
+    }
+
+    static constexpr bool is_sampler(unsigned type) {
+        switch (type) {
+            case GL_SAMPLER_1D:
+            case GL_SAMPLER_2D:
+            case GL_SAMPLER_3D:
+            case GL_SAMPLER_CUBE:
+            case GL_SAMPLER_1D_SHADOW:
+            case GL_SAMPLER_2D_SHADOW:
+            case GL_SAMPLER_CUBE_SHADOW:
+            case GL_SAMPLER_1D_ARRAY:
+            case GL_SAMPLER_2D_ARRAY:
+            case GL_SAMPLER_1D_ARRAY_SHADOW:
+            case GL_SAMPLER_2D_ARRAY_SHADOW:
+            case GL_SAMPLER_2D_RECT:
+            case GL_SAMPLER_2D_RECT_SHADOW:
+            case GL_SAMPLER_2D_MULTISAMPLE:
+            case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+            case GL_SAMPLER_BUFFER:
+            case GL_INT_SAMPLER_1D:
+            case GL_INT_SAMPLER_2D:
+            case GL_INT_SAMPLER_3D:
+            case GL_INT_SAMPLER_CUBE:
+            case GL_INT_SAMPLER_1D_ARRAY:
+            case GL_INT_SAMPLER_2D_ARRAY:
+            case GL_INT_SAMPLER_2D_RECT:
+            case GL_INT_SAMPLER_2D_MULTISAMPLE:
+            case GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+            case GL_INT_SAMPLER_BUFFER:
+            case GL_UNSIGNED_INT_SAMPLER_1D:
+            case GL_UNSIGNED_INT_SAMPLER_2D:
+            case GL_UNSIGNED_INT_SAMPLER_3D:
+            case GL_UNSIGNED_INT_SAMPLER_CUBE:
+            case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY:
+            case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+            case GL_UNSIGNED_INT_SAMPLER_2D_RECT:
+            case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE:
+            case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+            case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+                return true;
+        }
+        return false;
+    }
+
+    static constexpr std::uint32_t uniform_hash(std::string_view name, std::uint32_t seed) {
+        std::uint32_t hash = 2166136261u ^ seed;
+        for (char c : name) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // queries the active uniforms of the linked program and builds a
+    // collision free (perfect) hash table over their names. arrays are
+    // entered once per element ("x[1]", element 0 also as "x" and "x[0]"),
+    // the element locations need not be consecutive. every sampler (array
+    // element) gets a fixed texture unit, so draws only need to bind
+    // textures.
+    void introspect() {
+        if (!id)
+            return;
+
+        // sampler units are program state, leaves the program in use
+        pwgl::gl().use_program(id);
+        int next_unit = 0;
+
+        int count = 0;
+        int max_length = 0;
+        glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+        std::vector<char> buffer(static_cast<std::size_t>(max_length + 1));
+        for (int i = 0; i < count; ++i) {
+            int length = 0;
+            int size = 0;
+            unsigned type = 0;
+            glGetActiveUniform(id, static_cast<unsigned>(i), max_length, &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), static_cast<std::size_t>(length));
+            bool const array = name.ends_with("[0]");
+            if (array)
+                name.resize(name.size() - 3);
+
+            for (int element = 0; element < (array ? size : 1); ++element) {
+                std::string element_name = array ? name + '[' + std::to_string(element) + ']' : name;
+                int const location = glGetUniformLocation(id, element_name.c_str());
+                if (location < 0)   // uniform block members
+                    continue;
+                int unit = -1;
+                if (is_sampler(type)) {
+                    unit = next_unit++;
+                    glUniform1i(location, unit);
+                }
+                if (array && element == 0)
+                    uniforms.push_back({ name, location, type, unit });
+                uniforms.push_back({ std::move(element_name), location, type, unit });
+            }
+        }
+
+        // uniform blocks shared by every program have a fixed binding point
+        unsigned const frame_block = glGetUniformBlockIndex(id, frame_uniforms::block);
+        if (frame_block != GL_INVALID_INDEX)
+            glUniformBlockBinding(id, frame_block, frame_uniforms::binding);
+
+        std::size_t size = std::bit_ceil(std::max<std::size_t>(1, uniforms.size() * 2));
+        for (seed = 0; ; ++seed) {
+            if (seed && seed % 64 == 0)
+                size *= 2;
+            slots.assign(size, -1);
+            bool collision = false;
+            for (std::size_t i = 0; i < uniforms.size() && !collision; ++i) {
+                auto & slot = slots[uniform_hash(uniforms[i].name, seed) & (size - 1)];
+                collision = slot >= 0;
+                slot = static_cast<int>(i);
+            }
+            if (!collision)
+                break;
+        }
+    }
+
+    std::vector<uniform_info> uniforms;
+    std::vector<int> slots;
+    std::uint32_t seed { };
 };
 
 
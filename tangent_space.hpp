@@ -0,0 +1,298 @@
+#ifndef TANGENT_SPACE_HPP
+#define TANGENT_SPACE_HPP
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Smooth normal and tangent generation on the worker pool, GL free, for
+// any loader (import_file() with tangent_generator::parallel, the OBJ
+// importer). Meshes run in parallel and so do triangle and vertex ranges
+// within a mesh:
+//   1. per triangle / per corner values into SoA arrays (triangle ranges)
+//   2. corners bucketed per vertex (or per position) into incidence
+//      lists in corner order by a counting sort over corner ranges, so
+//      results do not depend on scheduling
+//   3. every vertex gathers over its own list (vertex ranges), nothing
+//      is written by two threads
+//
+// normals:  as aiProcess_GenSmoothNormals, the unit normal of every
+//           triangle touching a position, so UV seams shade smoothly
+// tangents: MikkTSpace weighting: the per triangle tangent is projected
+//           into the vertex's normal plane and weighted by the corner
+//           angle, bitangent = sign * cross(normal, tangent) with the sign
+//           of the UV orientation. Vertices are not split where mirrored
+//           UVs share a vertex, MikkTSpace would split those.
+
+namespace pwgl::detail {
+
+// corners grouped into buckets: bucket b holds the corners
+// entries[offsets[b]] .. entries[offsets[b + 1]], corner = triangle * 3 + i
+struct incidence {
+    std::vector<unsigned> offsets;
+    std::vector<unsigned> entries;
+};
+
+inline constexpr std::size_t tangent_grain = 16384;
+
+// counting sort of the corners: every job counts the buckets of its own
+// corner range, a prefix over (bucket, range) gives every range its own
+// cursor per bucket, and every job scatters its range. no atomics, and the
+// corners of a bucket end up in ascending order
+template <typename Bucket>
+incidence build_incidence(std::size_t corners, std::size_t buckets, Bucket const & bucket) {
+    auto & pool = workers();
+    std::size_t const parts = std::min<std::size_t>(pool.size(), std::max<std::size_t>(corners / tangent_grain, 1));
+    auto for_parts = [&](auto const & f) {
+        pool.parallel_for(parts, 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t part = begin; part < end; ++part)
+                f(part, corners * part / parts, corners * (part + 1) / parts);
+        });
+    };
+
+    // counts[part * buckets + b], later the part's cursor into bucket b
+    std::vector<unsigned> counts(parts * buckets, 0);
+    for_parts([&](std::size_t part, std::size_t first, std::size_t last) {
+        unsigned * count = counts.data() + part * buckets;
+        for (std::size_t c = first; c < last; ++c)
+            ++count[bucket(c)];
+    });
+
+    incidence in;
+    in.offsets.assign(buckets + 1, 0);
+    pool.parallel_for(buckets, tangent_grain, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t b = begin; b < end; ++b) {
+            unsigned total = 0;
+            for (std::size_t part = 0; part < parts; ++part)
+                total += counts[part * buckets + b];
+            in.offsets[b + 1] = total;
+        }
+    });
+    for (std::size_t b = 0; b < buckets; ++b)
+        in.offsets[b + 1] += in.offsets[b];
+    pool.parallel_for(buckets, tangent_grain, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t b = begin; b < end; ++b) {
+            unsigned cursor = in.offsets[b];
+            for (std::size_t part = 0; part < parts; ++part)
+                cursor += std::exchange(counts[part * buckets + b], cursor);
+        }
+    });
+
+    in.entries.resize(corners);
+    for_parts([&](std::size_t part, std::size_t first, std::size_t last) {
+        unsigned * cursor = counts.data() + part * buckets;
+        for (std::size_t c = first; c < last; ++c)
+            in.entries[cursor[bucket(c)]++] = static_cast<unsigned>(c);
+    });
+    return in;
+}
+
+// lowest index of a vertex at the same position (== compare, -0 == +0).
+// the vertices are hashed into partitions, each deduplicated by one job
+// over its own vertices, in ascending order.
+inline std::vector<unsigned> position_representatives(std::vector<vertex> const & vertices) {
+    auto & pool = workers();
+    std::size_t const n = vertices.size();
+    std::vector<std::uint32_t> hashes(n);
+    pool.parallel_for(n, tangent_grain, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t v = begin; v < end; ++v) {
+            auto const & p = vertices[v].Position;
+            std::uint64_t h = std::bit_cast<std::uint32_t>(p.x + 0.0f) * 0x9e3779b97f4a7c15ull;
+            h = (h ^ std::bit_cast<std::uint32_t>(p.y + 0.0f)) * 0xbf58476d1ce4e5b9ull;
+            h = (h ^ std::bit_cast<std::uint32_t>(p.z + 0.0f)) * 0x94d049bb133111ebull;
+            hashes[v] = static_cast<std::uint32_t>(h >> 32);
+        }
+    });
+
+    std::size_t const partitions = std::min<std::size_t>(pool.size(), std::max<std::size_t>(n / tangent_grain, 1));
+    incidence const members = build_incidence(n, partitions, [&](std::size_t v) { return hashes[v] % partitions; });
+
+    // slots hold the full hash next to the index, positions are only
+    // compared on equal hashes
+    std::vector<unsigned> representative(n);
+    pool.parallel_for(partitions, 1, [&](std::size_t begin, std::size_t end) {
+        std::vector<std::pair<std::uint32_t, unsigned>> slots;
+        for (std::size_t part = begin; part < end; ++part) {
+            std::size_t capacity = 16;
+            while (capacity < 2 * std::size_t(members.offsets[part + 1] - members.offsets[part]))
+                capacity *= 2;
+            slots.assign(capacity, { 0, ~0u });
+            for (unsigned e = members.offsets[part]; e < members.offsets[part + 1]; ++e) {
+                unsigned const v = members.entries[e];
+                std::uint32_t const h = hashes[v];
+                std::size_t s = (h / partitions) & (capacity - 1);
+                while (slots[s].second != ~0u && (slots[s].first != h || vertices[slots[s].second].Position != vertices[v].Position))
+                    s = (s + 1) & (capacity - 1);
+                if (slots[s].second == ~0u)
+                    slots[s] = { h, v };
+                representative[v] = slots[s].second;
+            }
+        }
+    });
+    return representative;
+}
+
+// acos within 7e-5 rad (Abramowitz & Stegun 4.4.45), branch free apart
+// from the sign, plenty for a weight
+inline float acos_approx(float x) {
+    float const a = std::min(std::abs(x), 1.0f);
+    float const r = std::sqrt(1.0f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - 0.0187293f * a)));
+    return x < 0.0f ? 3.14159265f - r : r;
+}
+
+// angle between a and b projected into the plane of n
+inline float corner_angle(glm::vec3 n, glm::vec3 a, glm::vec3 b) {
+    a -= n * glm::dot(n, a);
+    b -= n * glm::dot(n, b);
+    float const ab = glm::dot(a, a) * glm::dot(b, b);
+    if (ab <= 0.0f)
+        return 0.0f;
+    return acos_approx(glm::dot(a, b) / std::sqrt(ab));
+}
+
+} // pwgl::detail ns
+
+namespace pwgl {
+
+inline void generate_smooth_normals(mesh_data & mesh) {
+    auto & pool = workers();
+    auto & vertices = mesh.vertices;
+    auto const & indices = mesh.indices;
+    std::size_t const triangles = indices.size() / 3;
+
+    std::vector<float> nx(triangles);
+    std::vector<float> ny(triangles);
+    std::vector<float> nz(triangles);
+    pool.parallel_for(triangles, detail::tangent_grain, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t t = begin; t < end; ++t) {
+            glm::vec3 const a = vertices[indices[t * 3]].Position;
+            glm::vec3 n = glm::cross(vertices[indices[t * 3 + 1]].Position - a, vertices[indices[t * 3 + 2]].Position - a);
+            float const length = glm::length(n);
+            n = length > 0.0f ? n / length : glm::vec3(0.0f);
+            nx[t] = n.x;
+            ny[t] = n.y;
+            nz[t] = n.z;
+        }
+    });
+
+    auto const representative = detail::position_representatives(vertices);
+    auto const in = detail::build_incidence(triangles * 3, vertices.size(), [&](std::size_t c) {
+        return representative[indices[c]];
+    });
+    pool.parallel_for(vertices.size(), detail::tangent_grain, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t v = begin; v < end; ++v) {
+            if (representative[v] != v)
+                continue;
+            glm::vec3 n { 0.0f };
+            for (unsigned e = in.offsets[v]; e < in.offsets[v + 1]; ++e) {
+                std::size_t const t = in.entries[e] / 3;
+                n += glm::vec3(nx[t], ny[t], nz[t]);
+            }
+            float const length = glm::length(n);
+            vertices[v].Normal = length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+    });
+    pool.parallel_for(vertices.size(), detail::tangent_grain, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t v = begin; v < end; ++v) {
+            if (representative[v] != v)
+                vertices[v].Normal = vertices[representative[v]].Normal;
+        }
+    });
+}
+
+// needs normals and texture coordinates
+inline void generate_tangents(mesh_data & mesh) {
+    auto & pool = workers();
+    auto & vertices = mesh.vertices;
+    auto const & indices = mesh.indices;
+    std::size_t const corners = indices.size() / 3 * 3;
+
+    // per corner: the triangle's tangent in the plane of the corner's
+    // normal, weighted by the corner angle, and the angle signed with the
+    // UV orientation
+    std::vector<float> tx(corners);
+    std::vector<float> ty(corners);
+    std::vector<float> tz(corners);
+    std::vector<float> weight(corners);
+    pool.parallel_for(corners / 3, detail::tangent_grain, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t t = begin; t < end; ++t) {
+            vertex const * v[3] = { &vertices[indices[t * 3]], &vertices[indices[t * 3 + 1]], &vertices[indices[t * 3 + 2]] };
+            glm::vec3 const e1 = v[1]->Position - v[0]->Position;
+            glm::vec3 const e2 = v[2]->Position - v[0]->Position;
+            glm::vec2 const d1 = v[1]->TexCoords - v[0]->TexCoords;
+            glm::vec2 const d2 = v[2]->TexCoords - v[0]->TexCoords;
+            float const area = d1.x * d2.y - d1.y * d2.x;
+            float const orientation = area > 0.0f ? 1.0f : -1.0f;
+            glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) * orientation;
+            float const length = glm::length(tangent);
+            // no UV gradient: adds nothing
+            bool const valid = area != 0.0f && length > 0.0f && std::isfinite(length);
+
+            for (std::size_t i = 0; i < 3; ++i) {
+                std::size_t const c = t * 3 + i;
+                glm::vec3 const n = v[i]->Normal;
+                glm::vec3 projected = tangent - n * glm::dot(n, tangent);
+                float const projected_length = glm::length(projected);
+                float const angle = valid && projected_length > 0.0f
+                    ? detail::corner_angle(n, v[(i + 1) % 3]->Position - v[i]->Position, v[(i + 2) % 3]->Position - v[i]->Position)
+                    : 0.0f;
+                projected *= angle > 0.0f ? angle / projected_length : 0.0f;
+                tx[c] = projected.x;
+                ty[c] = projected.y;
+                tz[c] = projected.z;
+                weight[c] = angle * orientation;
+            }
+        }
+    });
+
+    auto const in = detail::build_incidence(corners, vertices.size(), [&](std::size_t c) {
+        return indices[c];
+    });
+    pool.parallel_for(vertices.size(), detail::tangent_grain, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t v = begin; v < end; ++v) {
+            glm::vec3 sum { 0.0f };
+            float sign = 0.0f;
+            for (unsigned e = in.offsets[v]; e < in.offsets[v + 1]; ++e) {
+                std::size_t const c = in.entries[e];
+                sum += glm::vec3(tx[c], ty[c], tz[c]);
+                sign += weight[c];
+            }
+
+            glm::vec3 const n = vertices[v].Normal;
+            float const length = glm::length(sum);
+            // no UV gradient: any frame around the normal
+            glm::vec3 const t = length > 0.0f
+                ? sum / length
+                : glm::normalize(glm::cross(n, std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f)));
+            vertices[v].Tangent = t;
+            vertices[v].Bitangent = glm::cross(n, t) * (sign < 0.0f ? -1.0f : 1.0f);
+        }
+    });
+}
+
+// normals for the meshes that have none (all zero), then tangents
+inline void generate_tangent_space(std::vector<mesh_data> & meshes) {
+    workers().parallel_for(meshes.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t m = begin; m < end; ++m) {
+            auto & mesh = meshes[m];
+            bool const normals = std::any_of(std::begin(mesh.vertices), std::end(mesh.vertices), [](vertex const & v) {
+                return v.Normal != glm::vec3(0.0f);
+            });
+            if (!normals)
+                generate_smooth_normals(mesh);
+            generate_tangents(mesh);
+        }
+    });
+}
+
+} // pwgl ns
+#endif
@@ -0,0 +1,101 @@
+#ifndef TEXTURE_CACHE_HPP
+#define TEXTURE_CACHE_HPP
+
+#include <GL/glew.h>
+
+#include "gl_state.hpp"
+
+#include "fmt/format.h"
+
+#include <compare>
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace pwgl {
+
+// owning GL texture name, deleted when the last model referencing it goes away
+struct texture_handle {
+    explicit texture_handle(unsigned name)
+        : id(name)
+    { }
+    ~texture_handle() {
+        pwgl::gl().delete_texture(id);
+    }
+    texture_handle(texture_handle const &) = delete;
+    texture_handle & operator=(texture_handle const &) = delete;
+
+    unsigned id { };
+};
+
+// identifies a decoded image: canonical file path plus the decode options.
+// the vertical flip is not one of them, stb_image (v2.14) only has the
+// process wide stbi_set_flip_vertically_on_load()
+struct texture_key {
+    std::string path;
+    int channels { 0 }; // 0: as stored in the file
+
+    static texture_key from(std::string const & filename, int channels = 0) {
+        std::error_code ec;
+        auto canonical = std::filesystem::weakly_canonical(filename, ec);
+        return { ec ? filename : canonical.string(), channels };
+    }
+
+    auto operator<=>(texture_key const &) const = default;
+};
+
+// process wide map of resident textures, entries expire with their last user
+class texture_cache {
+public:
+    static texture_cache & instance() {
+        static texture_cache cache;
+        return cache;
+    }
+
+    std::shared_ptr<texture_handle> find(texture_key const & key) {
+        std::lock_guard lock(mutex);
+        auto it = entries.find(key);
+        if (it != std::end(entries)) {
+            if (auto handle = it->second.lock()) {
+                ++hits;
+                return handle;
+            }
+            entries.erase(it);
+        }
+        ++misses;
+        return nullptr;
+    }
+
+    std::shared_ptr<texture_handle> insert(texture_key const & key, unsigned id) {
+        auto handle = std::make_shared<texture_handle>(id);
+        std::lock_guard lock(mutex);
+        entries[key] = handle;
+        return handle;
+    }
+
+    std::size_t resident() {
+        std::lock_guard lock(mutex);
+        std::erase_if(entries, [](auto const & entry) { return entry.second.expired(); });
+        return entries.size();
+    }
+
+    void print_stats() {
+        auto const count = resident();
+        fmt::print("[~] texture cache: hits: {}, misses: {}, resident: {}\n", hits, misses, count);
+    }
+
+    std::size_t hits { };
+    std::size_t misses { };
+
+private:
+    texture_cache() = default;
+
+    std::map<texture_key, std::weak_ptr<texture_handle>> entries;
+    std::mutex mutex;
+};
+
+} // pwgl ns
+#endif
@@ -0,0 +1,144 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace pwgl {
+
+// fixed size pool of worker threads consuming a FIFO of jobs
+class thread_pool {
+public:
+    explicit thread_pool(std::size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+        for (std::size_t i = 0; i < threads; ++i)
+            workers.emplace_back([this] { run(); });
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto & worker : workers)
+            worker.join();
+    }
+
+    thread_pool(thread_pool const &) = delete;
+    thread_pool & operator=(thread_pool const &) = delete;
+
+    template <typename F>
+    auto submit(F && f) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using result_type = std::invoke_result_t<std::decay_t<F>>;
+        auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(f));
+        auto future = task->get_future();
+        {
+            std::lock_guard lock(mutex);
+            jobs.emplace_back([task] { (*task)(); });
+        }
+        cv.notify_one();
+        return future;
+    }
+
+    std::size_t size() const {
+        return workers.size();
+    }
+
+    // runs one queued job on the calling thread, false if there was none
+    bool run_pending() {
+        std::function<void()> job;
+        {
+            std::lock_guard lock(mutex);
+            if (jobs.empty())
+                return false;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+        return true;
+    }
+
+    // f(begin, end) over [0, count) in pieces of at least grain items, on
+    // the pool and the calling thread. the caller runs queued jobs while it
+    // waits, so jobs of this pool may call it as well.
+    template <typename F>
+    void parallel_for(std::size_t count, std::size_t grain, F const & f) {
+        grain = std::max<std::size_t>(grain, 1);
+        std::size_t const pieces = std::min((count + grain - 1) / grain, size() * 4);
+        if (pieces <= 1) {
+            if (count)
+                f(std::size_t(0), count);
+            return;
+        }
+
+        std::vector<std::future<void>> done;
+        done.reserve(pieces - 1);
+        for (std::size_t i = 1; i < pieces; ++i)
+            done.push_back(submit([&f, begin = count * i / pieces, end = count * (i + 1) / pieces] { f(begin, end); }));
+        std::exception_ptr error;
+        try {
+            f(std::size_t(0), count / pieces);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // every piece refers to f, wait for all before an exception leaves
+        for (auto & d : done) {
+            while (d.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                if (!run_pending())
+                    d.wait();
+            }
+        }
+        for (auto & d : done) {
+            try {
+                d.get();
+            } catch (...) {
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock lock(mutex);
+                cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping { false };
+};
+
+// process wide pool shared by the loaders
+inline thread_pool & workers() {
+    static thread_pool pool;
+    return pool;
+}
+
+} // pwgl ns
+#endif
@@ -0,0 +1,267 @@
+#ifndef UPLOAD_THREAD_HPP
+#define UPLOAD_THREAD_HPP
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "image.hpp"
+#include "vertex_arena.hpp"
+
+#include "fmt/format.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Texture and buffer uploads on a second GL context sharing its objects
+// with the render window. The context is owned by a thread of its own
+// consuming a FIFO of jobs: a job copies its data into a pixel buffer
+// object, lets GL copy from there into the texture or buffer, fences the
+// copy (glFenceSync) and flushes. The render thread polls the returned
+// upload_ticket and uses the object once the fence has passed, so it never
+// waits for a transfer.
+//
+// Textures and buffers are shared between the contexts, VAOs are not.
+// pwgl::gl() shadows the render context only, the upload context binds
+// with plain GL calls.
+//
+// Needs nothing beyond shared contexts, headless e.g. with Mesa's llvmpipe:
+// LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./uploadcheck
+
+namespace pwgl {
+
+// GL name (0 for buffer writes) and the fence of the copies of a job
+struct upload_fence {
+    unsigned id { };
+    GLsync fence { };
+};
+
+// pending result of an upload job, polled on the render thread
+class upload_ticket {
+public:
+    upload_ticket() = default;
+    explicit upload_ticket(std::future<upload_fence> f)
+        : future(std::move(f))
+    { }
+    upload_ticket(upload_ticket && other) noexcept
+        : future(std::move(other.future))
+        , result(std::exchange(other.result, { }))
+        , received(other.received)
+    { }
+    upload_ticket & operator=(upload_ticket && other) noexcept {
+        std::swap(future, other.future);
+        std::swap(result, other.result);
+        std::swap(received, other.received);
+        return *this;
+    }
+    ~upload_ticket() {
+        if (result.fence)
+            glDeleteSync(result.fence);
+    }
+
+    bool valid() const {
+        return received || future.valid();
+    }
+
+    // true once the job ran and the GPU finished its copies, never blocks.
+    // rethrows an exception of the job.
+    bool done() {
+        if (!received) {
+            if (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return false;
+            result = future.get();
+            received = true;
+        }
+        if (!result.fence)
+            return true;
+        if (glClientWaitSync(result.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            return false;
+        glDeleteSync(result.fence);
+        result.fence = nullptr;
+        return true;
+    }
+
+    unsigned id() const {
+        return result.id;
+    }
+
+private:
+    std::future<upload_fence> future;
+    upload_fence result;
+    bool received { };
+};
+
+class upload_thread {
+public:
+    // GLFW creates windows on the main thread only, so the hidden window of
+    // the upload context is created here and handed to the thread
+    explicit upload_thread(GLFWwindow * shared) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_MAXIMIZED, GLFW_FALSE);
+        context = glfwCreateWindow(1, 1, "pwgl upload", nullptr, shared);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+        if (!context)
+            throw std::logic_error("could not create the upload context");
+        // glfwCreateWindow leaves the current context alone
+        worker = std::thread([this] { run(); });
+        fmt::print("[~] upload_thread: started\n");
+    }
+    upload_thread(upload_thread const &) = delete;
+    upload_thread & operator=(upload_thread const &) = delete;
+
+    // finishes the queued jobs, has to run before glfwTerminate()
+    ~upload_thread() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        worker.join();
+        glfwDestroyWindow(context);
+    }
+
+    // creates a mipmapped GL_TEXTURE_2D, sampled like upload_image()
+    upload_ticket texture(decoded_image image) {
+        return submit([this, image = std::move(image)] {
+            upload_fence result;
+            glGenTextures(1, &result.id);
+            glBindTexture(GL_TEXTURE_2D, result.id);
+            if (image.data) {
+                GLenum const format = image_format(image.components);
+                auto const bytes = static_cast<std::size_t>(image.width) * static_cast<std::size_t>(image.height) *
+                                   static_cast<std::size_t>(image.components);
+                std::memcpy(map_staging(GL_PIXEL_UNPACK_BUFFER, bytes), image.data.get(), bytes);
+                unmap_staging(GL_PIXEL_UNPACK_BUFFER);
+                glTexImage2D(GL_TEXTURE_2D, 0, static_cast<int>(format), image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                finish_texture();
+            } else {
+                fmt::print("[-] upload_thread: texture failed to load at file: {}\n", image.filename);
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+            result.fence = fence();
+            return result;
+        });
+    }
+
+    // copies into buffers created by the calling (render) thread. keep_alive
+    // owns the sources of the writes until the job has run.
+    upload_ticket write_buffers(std::span<buffer_write const> writes, std::shared_ptr<void const> keep_alive) {
+        // buffers created or resized in this context reach the upload
+        // context through a fence
+        GLsync const created = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        return submit([this, w = std::vector<buffer_write>(std::begin(writes), std::end(writes)),
+                       keep_alive = std::move(keep_alive), created] {
+            glWaitSync(created, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(created);
+
+            std::size_t bytes = 0;
+            for (auto const & write : w)
+                bytes += write.bytes;
+            if (!bytes)
+                return upload_fence { 0, fence() };
+            auto * staged = map_staging(GL_COPY_READ_BUFFER, bytes);
+            for (auto const & write : w) {
+                std::memcpy(staged, write.data, write.bytes);
+                staged += write.bytes;
+            }
+            unmap_staging(GL_COPY_READ_BUFFER);
+
+            std::size_t offset = 0;
+            for (auto const & write : w) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, write.buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(offset),
+                                    static_cast<GLintptr>(write.offset), static_cast<GLsizeiptr>(write.bytes));
+                offset += write.bytes;
+            }
+            return upload_fence { 0, fence() };
+        });
+    }
+
+    std::size_t pending() {
+        std::lock_guard lock(mutex);
+        return jobs.size();
+    }
+
+private:
+    template <typename F>
+    upload_ticket submit(F && f) {
+        auto task = std::make_shared<std::packaged_task<upload_fence()>>(std::forward<F>(f));
+        upload_ticket ticket(task->get_future());
+        {
+            std::lock_guard lock(mutex);
+            jobs.emplace_back([task] { (*task)(); });
+        }
+        cv.notify_one();
+        return ticket;
+    }
+
+    void run() {
+        glfwMakeContextCurrent(context);
+        glGenBuffers(1, &staging);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock lock(mutex);
+                cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    break;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+        glDeleteBuffers(1, &staging);
+        glFinish();
+        glfwMakeContextCurrent(nullptr);
+    }
+
+    // orphans the staging buffer, binds it to target and maps bytes of it.
+    // the copies reading the previous contents keep the old storage.
+    std::uint8_t * map_staging(GLenum target, std::size_t bytes) {
+        glBindBuffer(target, staging);
+        glBufferData(target, static_cast<GLsizeiptr>(bytes), nullptr, GL_STREAM_DRAW);
+        auto * p = static_cast<std::uint8_t *>(glMapBufferRange(target, 0, static_cast<GLsizeiptr>(bytes),
+                                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (!p)
+            throw std::logic_error("could not map the upload staging buffer");
+        return p;
+    }
+
+    static void unmap_staging(GLenum target) {
+        if (!glUnmapBuffer(target))
+            throw std::logic_error("upload staging buffer lost while mapped");
+    }
+
+    // flushed, so the render context can wait for it
+    static GLsync fence() {
+        GLsync const f = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        return f;
+    }
+
+    GLFWwindow * context { };
+    unsigned staging { };
+    std::thread worker;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping { false };
+};
+
+} // pwgl ns
+#endif
@@ -0,0 +1,179 @@
+// headless check of pwgl::upload_thread: uploads generated textures and
+// buffers on the upload context, reads them back on the main context.
+// e.g. with Mesa's software rasterizer:
+//   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./uploadcheck [rounds]
+#define STB_IMAGE_IMPLEMENTATION
+
+#include "upload_thread.hpp"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fmt/format.h"
+
+namespace {
+
+struct image_spec {
+    int width;
+    int height;
+    int components;
+};
+
+// odd widths exercise the unpack alignment of RGB and single channel rows
+constexpr image_spec images[] = {
+    { 1024, 1024, 4 }, { 333, 77, 3 }, { 513, 255, 1 }, { 2048, 1024, 3 }, { 1, 1, 4 },
+};
+
+pwgl::decoded_image make_image(image_spec spec, std::mt19937 & rng)
+{
+    pwgl::decoded_image image;
+    image.filename = fmt::format("generated {}x{}x{}", spec.width, spec.height, spec.components);
+    image.width = spec.width;
+    image.height = spec.height;
+    image.components = spec.components;
+    auto const bytes = static_cast<std::size_t>(spec.width * spec.height * spec.components);
+    // released by stbi_image_free, which is free()
+    image.data.reset(static_cast<unsigned char *>(std::malloc(bytes)));
+    std::generate_n(image.data.get(), bytes, [&] { return static_cast<unsigned char>(rng()); });
+    return image;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// polls like a render loop would until every ticket is done, returns the
+// longest single poll in ms
+double wait(std::vector<pwgl::upload_ticket> & tickets)
+{
+    double longest = 0.0;
+    for (;;) {
+        auto const start = std::chrono::steady_clock::now();
+        bool const all = std::all_of(std::begin(tickets), std::end(tickets), [](auto & t) { return t.done(); });
+        longest = std::max(longest, elapsed_ms(start));
+        if (all)
+            return longest;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+int check(int rounds)
+{
+    pwgl::upload_thread uploads(glfwGetCurrentContext());
+    std::mt19937 rng(42);
+    int failures = 0;
+
+    // textures
+    std::vector<std::vector<unsigned char>> expected;
+    std::vector<pwgl::upload_ticket> tickets;
+    std::size_t texture_bytes = 0;
+    for (int round = 0; round < rounds; ++round) {
+        for (auto spec : images) {
+            auto image = make_image(spec, rng);
+            auto const bytes = static_cast<std::size_t>(spec.width * spec.height * spec.components);
+            expected.emplace_back(image.data.get(), image.data.get() + bytes);
+            texture_bytes += bytes;
+            tickets.push_back(uploads.texture(std::move(image)));
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    double longest = wait(tickets);
+    fmt::print("[~] textures: {}, {:.1f} MiB, resident after {:.2f} ms, longest poll {:.3f} ms\n",
+               tickets.size(), double(texture_bytes) / (1 << 20), elapsed_ms(start), longest);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (std::size_t i = 0; i < tickets.size(); ++i) {
+        auto const spec = images[i % std::size(images)];
+        std::vector<unsigned char> actual(expected[i].size());
+        pwgl::gl().bind_texture(0, tickets[i].id());
+        glGetTexImage(GL_TEXTURE_2D, 0, pwgl::image_format(spec.components), GL_UNSIGNED_BYTE, actual.data());
+        if (actual != expected[i]) {
+            fmt::print("[-] texture {} ({}x{}x{}) differs\n", i, spec.width, spec.height, spec.components);
+            ++failures;
+        }
+        pwgl::gl().delete_texture(tickets[i].id());
+    }
+
+    // buffers, created here and filled by the upload context
+    std::size_t const buffer_size = 8 << 20;
+    std::vector<unsigned> buffers(static_cast<std::size_t>(rounds));
+    std::vector<std::uint8_t> source(buffer_size);
+    std::generate(std::begin(source), std::end(source), [&] { return static_cast<std::uint8_t>(rng()); });
+    auto const keep_alive = std::make_shared<std::vector<std::uint8_t>>(source);
+    tickets.clear();
+    for (auto & buffer : buffers) {
+        glGenBuffers(1, &buffer);
+        pwgl::gl().bind_buffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(buffer_size), nullptr, GL_STATIC_DRAW);
+        // two halves, swapped, to check the offsets
+        std::size_t const half = buffer_size / 2;
+        pwgl::buffer_write const writes[] = {
+            { buffer, 0, keep_alive->data() + half, half },
+            { buffer, half, keep_alive->data(), half },
+        };
+        tickets.push_back(uploads.write_buffers(writes, keep_alive));
+    }
+    start = std::chrono::steady_clock::now();
+    longest = wait(tickets);
+    fmt::print("[~] buffers: {}, {:.1f} MiB, resident after {:.2f} ms, longest poll {:.3f} ms\n",
+               buffers.size(), double(buffers.size() * buffer_size) / (1 << 20), elapsed_ms(start), longest);
+
+    std::rotate(std::begin(source), std::begin(source) + buffer_size / 2, std::end(source));
+    for (std::size_t i = 0; i < buffers.size(); ++i) {
+        std::vector<std::uint8_t> actual(buffer_size);
+        pwgl::gl().bind_buffer(GL_ARRAY_BUFFER, buffers[i]);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(buffer_size), actual.data());
+        if (actual != source) {
+            fmt::print("[-] buffer {} differs\n", i);
+            ++failures;
+        }
+        pwgl::gl().delete_buffer(buffers[i]);
+    }
+
+    fmt::print("{} {} failures\n", failures ? "[-]" : "[~]", failures);
+    return failures ? 1 : 0;
+}
+
+} // anon ns
+
+int main(int argc, char ** argv)
+{
+    int const rounds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 4;
+
+    if (!glfwInit())
+        throw std::logic_error("could not initialize GLFW");
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow * window = glfwCreateWindow(1, 1, "uploadcheck", nullptr, nullptr);
+    if (!window) {
+        glfwTerminate();
+        throw std::logic_error("could not create a GL context with GLFW3");
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+    if (glewInit())
+        throw std::logic_error("could not initialize GLEW");
+    fmt::print("[~] renderer: {}, {}\n", reinterpret_cast<char const *>(glGetString(GL_RENDERER)),
+               reinterpret_cast<char const *>(glGetString(GL_VERSION)));
+
+    int const result = check(rounds);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return result;
+}
@@ -0,0 +1,306 @@
+#ifndef VERTEX_ARENA_HPP
+#define VERTEX_ARENA_HPP
+
+#include <GL/glew.h>
+
+#include "frame_stats.hpp"
+#include "gl_state.hpp"
+#include "mesh_data.hpp"
+#include "ring_buffer.hpp"
+#include "vertex_packing.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace pwgl {
+
+// location of one mesh inside a vertex_arena and the dequantization of its
+// positions (identity for vertex_format::full). meshes with at most 65536
+// vertices use 16 bit indices.
+struct mesh_range {
+    int base_vertex { };
+    std::size_t index_offset { };   // bytes
+    std::size_t index_count { };
+    unsigned index_type { GL_UNSIGNED_INT };
+    glm::vec3 position_offset { 0.0f };
+    glm::vec3 position_scale { 1.0f };
+};
+
+// one copy into a GL buffer, data has to stay valid until the copy is done
+struct buffer_write {
+    unsigned buffer { };
+    std::size_t offset { };     // bytes
+    void const * data { };
+    std::size_t bytes { };
+};
+
+// layout of a vertex_arena computed before any GL call. the index lists
+// of a mesh's LOD levels follow its base indices and share its vertices.
+struct arena_plan {
+    vertex_format format { vertex_format::full };
+    std::vector<mesh_range> ranges;
+    std::vector<std::vector<mesh_range>> lods;          // per mesh, coarser levels
+    std::vector<packed_mesh> packed;                    // vertex_format::packed only
+    std::vector<std::vector<std::uint16_t>> narrow;     // per mesh, empty for 32 bit indices
+    std::vector<std::vector<unsigned>> wide;            // per mesh with LODs and 32 bit indices, all levels
+    std::size_t vertex_bytes { };
+    std::size_t index_bytes { };
+};
+
+// one VAO/VBO/EBO holding the vertices and indices of many meshes sharing
+// one vertex layout, drawn with glDrawElementsBaseVertex
+struct vertex_arena {
+    vertex_arena() = default;
+    vertex_arena(vertex_arena const &) = delete;
+    vertex_arena & operator=(vertex_arena const &) = delete;
+    vertex_arena(vertex_arena && other) noexcept
+        : vao(std::exchange(other.vao, 0))
+        , vbo(std::exchange(other.vbo, 0))
+        , ebo(std::exchange(other.ebo, 0))
+        , format(other.format)
+    { }
+
+    ~vertex_arena() {
+        if (!vao)
+            return;
+        gl().delete_vertex_array(vao);
+        gl().delete_buffer(vbo);
+        gl().delete_buffer(ebo);
+    }
+
+    // CPU side of build(): ranges and converted vertices/indices, may be
+    // prepared on any thread
+    static arena_plan plan(std::vector<mesh_data> const & meshes, vertex_format layout = vertex_format::full) {
+        arena_plan p;
+        p.format = layout;
+        std::size_t const stride = layout == vertex_format::packed ? sizeof(packed_vertex) : sizeof(vertex);
+
+        if (layout == vertex_format::packed) {
+            for (auto const & m : meshes)
+                p.packed.emplace_back(pack_vertices(m.vertices));
+        }
+
+        std::size_t vertex_count = 0;
+        for (auto const & m : meshes) {
+            bool const narrow = m.vertices.size() <= 65536;
+            std::size_t const index_size = narrow ? sizeof(std::uint16_t) : sizeof(unsigned);
+            p.index_bytes = (p.index_bytes + index_size - 1) / index_size * index_size;
+            p.ranges.push_back({ static_cast<int>(vertex_count), p.index_bytes, m.indices.size(),
+                                 narrow ? unsigned(GL_UNSIGNED_SHORT) : unsigned(GL_UNSIGNED_INT) });
+            if (!p.packed.empty()) {
+                p.ranges.back().position_offset = p.packed[p.ranges.size() - 1].offset;
+                p.ranges.back().position_scale = p.packed[p.ranges.size() - 1].scale;
+            }
+
+            std::size_t index_count = m.indices.size();
+            auto & lods = p.lods.emplace_back();
+            for (auto const & lod : m.lods) {
+                auto & range = lods.emplace_back(p.ranges.back());
+                range.index_offset = p.index_bytes + index_count * index_size;
+                range.index_count = lod.indices.size();
+                index_count += lod.indices.size();
+            }
+
+            // all levels in one list, written with a single copy
+            p.narrow.emplace_back();
+            p.wide.emplace_back();
+            auto gather = [&m](auto & out) {
+                out.assign(std::begin(m.indices), std::end(m.indices));
+                for (auto const & lod : m.lods)
+                    out.insert(std::end(out), std::begin(lod.indices), std::end(lod.indices));
+            };
+            if (narrow)
+                gather(p.narrow.back());
+            else if (!m.lods.empty())
+                gather(p.wide.back());
+            vertex_count += m.vertices.size();
+            p.index_bytes += index_count * index_size;
+        }
+        p.vertex_bytes = vertex_count * stride;
+        return p;
+    }
+
+    // uploads all meshes, returns the plan with the ranges of each in the
+    // same order
+    arena_plan build(std::vector<mesh_data> const & meshes, vertex_format layout = vertex_format::full) {
+        auto p = plan(meshes, layout);
+        allocate(p);
+        for (std::size_t i = 0; i < meshes.size(); ++i)
+            upload(p, meshes, i);
+        return p;
+    }
+
+    // creates the buffers (uninitialized) and the vertex layout of a plan
+    void allocate(arena_plan const & p) {
+        format = p.format;
+
+        glGenVertexArrays(1, &vao);
+        gl().bind_vertex_array(vao);
+
+        glGenBuffers(1, &vbo);
+        gl().bind_buffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(p.vertex_bytes), nullptr, GL_STATIC_DRAW);
+
+        glGenBuffers(1, &ebo);
+        gl().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(p.index_bytes), nullptr, GL_STATIC_DRAW);
+
+        if (format == vertex_format::packed)
+            packed_attributes();
+        else
+            full_attributes();
+
+        // per instance model matrix (5..8) and color (9), pointed at the
+        // stream and enabled by begin_instances()
+        for (unsigned column = 0; column < 4; ++column)
+            glVertexAttribDivisor(instance_attribute + column, 1);
+        glVertexAttribDivisor(color_attribute, 1);
+
+        gl().bind_vertex_array(0);
+    }
+
+    // copies the vertices and indices of mesh i into the allocated buffers,
+    // the mesh can be drawn afterwards. does not touch the bound VAO.
+    void upload(arena_plan const & p, std::vector<mesh_data> const & meshes, std::size_t i) const {
+        for (auto const & w : writes(p, meshes, i)) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, w.buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(w.offset), static_cast<GLsizeiptr>(w.bytes), w.data);
+        }
+    }
+
+    // the copies upload() makes for mesh i, pointing into p and meshes
+    std::array<buffer_write, 2> writes(arena_plan const & p, std::vector<mesh_data> const & meshes, std::size_t i) const {
+        auto const & m = meshes[i];
+        auto const & range = p.ranges[i];
+        std::size_t const stride = vertex_size();
+        void const * vertices = p.packed.empty() ? static_cast<void const *>(m.vertices.data()) : p.packed[i].vertices.data();
+
+        buffer_write indices { ebo, range.index_offset, m.indices.data(), m.indices.size() * sizeof(unsigned) };
+        if (range.index_type == GL_UNSIGNED_SHORT) {
+            indices.data = p.narrow[i].data();
+            indices.bytes = p.narrow[i].size() * sizeof(std::uint16_t);
+        } else if (!p.wide[i].empty()) {
+            indices.data = p.wide[i].data();
+            indices.bytes = p.wide[i].size() * sizeof(unsigned);
+        }
+        return { buffer_write { vbo, static_cast<std::size_t>(range.base_vertex) * stride, vertices, m.vertices.size() * stride },
+                 indices };
+    }
+
+    // writes per instance data into this frame's region of the stream and
+    // enables the instance attributes of the bound arena. without colors
+    // every instance is drawn white.
+    void begin_instances(ring_buffer & stream, std::span<glm::mat4 const> transforms, std::span<glm::vec4 const> colors = { }) {
+        instance_buffer = stream.buffer;
+        transform_base = stream.write(transforms.data(), transforms.size_bytes()).offset;
+        has_colors = colors.size() >= transforms.size() && !colors.empty();
+        if (has_colors)
+            color_base = stream.write(colors.data(), colors.size_bytes()).offset;
+        stream.flush();
+
+        instance_offset(0);
+        for (unsigned column = 0; column < 4; ++column)
+            glEnableVertexAttribArray(instance_attribute + column);
+        if (has_colors) {
+            glEnableVertexAttribArray(color_attribute);
+        } else {
+            glDisableVertexAttribArray(color_attribute);
+            glVertexAttrib4f(color_attribute, 1.0f, 1.0f, 1.0f, 1.0f);
+        }
+    }
+
+    void end_instances() const {
+        for (unsigned column = 0; column < 4; ++column)
+            glDisableVertexAttribArray(instance_attribute + column);
+        glDisableVertexAttribArray(color_attribute);
+    }
+
+    std::size_t vertex_size() const {
+        return format == vertex_format::packed ? sizeof(packed_vertex) : sizeof(vertex);
+    }
+
+    void bind() const {
+        gl().bind_vertex_array(vao);
+    }
+
+    // re-points the instance attributes at instance first of the stream,
+    // for GL versions without base instance support
+    void instance_offset(std::size_t first) const {
+        gl().bind_buffer(GL_ARRAY_BUFFER, instance_buffer);
+        for (unsigned column = 0; column < 4; ++column)
+            glVertexAttribPointer(instance_attribute + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (void*)(transform_base + first * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+        if (has_colors)
+            glVertexAttribPointer(color_attribute, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4),
+                                  (void*)(color_base + first * sizeof(glm::vec4)));
+    }
+
+    static void draw(mesh_range const & range) {
+        ++stats().draw_calls;
+        ++stats().draw_commands;
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<int>(range.index_count), range.index_type,
+                                 (void*)range.index_offset, range.base_vertex);
+    }
+
+    static void draw(mesh_range const & range, std::size_t instances) {
+        ++stats().draw_calls;
+        ++stats().draw_commands;
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<int>(range.index_count), range.index_type,
+                                          (void*)range.index_offset, static_cast<int>(instances), range.base_vertex);
+    }
+
+    static constexpr unsigned instance_attribute = 5;
+    static constexpr unsigned color_attribute = 9;
+
+    unsigned vao { };
+    unsigned vbo { };
+    unsigned ebo { };
+    vertex_format format { vertex_format::full };
+
+private:
+    // instance stream of the last begin_instances()
+    unsigned instance_buffer { };
+    std::size_t transform_base { };
+    std::size_t color_base { };
+    bool has_colors { };
+
+    static void full_attributes() {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, TexCoords));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, Tangent));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)offsetof(vertex, Bitangent));
+    }
+
+    // same locations as full_attributes(), no bitangent
+    static void packed_attributes() {
+        // position + handedness
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, sizeof(packed_vertex), (void*)offsetof(packed_vertex, position));
+        // octahedral normal
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(packed_vertex), (void*)offsetof(packed_vertex, normal));
+        // texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(packed_vertex), (void*)offsetof(packed_vertex, texcoords));
+        // octahedral tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(packed_vertex), (void*)offsetof(packed_vertex, tangent));
+    }
+};
+
+} // pwgl ns
+#endif
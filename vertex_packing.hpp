@@ -0,0 +1,116 @@
+#ifndef VERTEX_PACKING_HPP
+#define VERTEX_PACKING_HPP
+
+#include <glm/glm.hpp>
+
+#include "mesh_data.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Quantized vertex layout (20 bytes instead of the 56 of pwgl::vertex):
+//   position:  3 x snorm16 relative to the mesh bounds, w: tangent handedness
+//   normal:    octahedral encoded, 2 x snorm16
+//   tangent:   octahedral encoded, 2 x snorm16 (bitangent = cross(n, t) * w)
+//   texcoords: 2 x half float
+// decoded in resources/shaders/model_loading.glsl
+
+namespace pwgl {
+
+enum class vertex_format {
+    full,
+    packed,
+};
+
+struct packed_vertex {
+    std::int16_t position[4];
+    std::int16_t normal[2];
+    std::int16_t tangent[2];
+    std::uint16_t texcoords[2];
+};
+
+static_assert(sizeof(packed_vertex) == 20);
+
+// packed vertices of one mesh, position = offset + scale * snorm(position)
+struct packed_mesh {
+    std::vector<packed_vertex> vertices;
+    glm::vec3 offset { 0.0f };
+    glm::vec3 scale { 1.0f };
+};
+
+inline std::int16_t to_snorm16(float v) {
+    return static_cast<std::int16_t>(std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+
+// IEEE 754 binary16, round to nearest, flushes denormals to zero
+inline std::uint16_t to_half(float f) {
+    auto const bits = std::bit_cast<std::uint32_t>(f);
+    auto const sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+    int const exponent = static_cast<int>((bits >> 23) & 0xffu) - 127 + 15;
+    std::uint32_t const mantissa = bits & 0x7fffffu;
+
+    if (((bits >> 23) & 0xffu) == 0xffu)  // inf/nan
+        return static_cast<std::uint16_t>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+    if (exponent <= 0)
+        return sign;
+    if (exponent >= 31)
+        return static_cast<std::uint16_t>(sign | 0x7c00u);
+
+    std::uint32_t half = (static_cast<std::uint32_t>(exponent) << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000u)     // round, may carry into the exponent
+        ++half;
+    return static_cast<std::uint16_t>(sign | std::min(half, 0x7c00u));
+}
+
+// maps a unit vector onto the [-1, 1]^2 octahedron
+inline glm::vec2 oct_encode(glm::vec3 n) {
+    float const l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.0f)
+        return { 0.0f, 0.0f };
+    n = n / l1;
+    glm::vec2 p { n.x, n.y };
+    if (n.z < 0.0f) {
+        p = {
+            (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f),
+        };
+    }
+    return p;
+}
+
+inline packed_mesh pack_vertices(std::vector<vertex> const & vertices) {
+    packed_mesh packed;
+    if (vertices.empty())
+        return packed;
+
+    glm::vec3 lo = vertices.front().Position;
+    glm::vec3 hi = lo;
+    for (auto const & v : vertices) {
+        lo = glm::min(lo, v.Position);
+        hi = glm::max(hi, v.Position);
+    }
+    packed.offset = (lo + hi) * 0.5f;
+    packed.scale = glm::max((hi - lo) * 0.5f, glm::vec3(1e-20f));
+
+    packed.vertices.reserve(vertices.size());
+    for (auto const & v : vertices) {
+        glm::vec3 const p = (v.Position - packed.offset) / packed.scale;
+        glm::vec2 const n = oct_encode(v.Normal);
+        glm::vec2 const t = oct_encode(v.Tangent);
+        float const handedness = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+
+        packed.vertices.push_back({
+            { to_snorm16(p.x), to_snorm16(p.y), to_snorm16(p.z), to_snorm16(handedness) },
+            { to_snorm16(n.x), to_snorm16(n.y) },
+            { to_snorm16(t.x), to_snorm16(t.y) },
+            { to_half(v.TexCoords.x), to_half(v.TexCoords.y) },
+        });
+    }
+    return packed;
+}
+
+} // pwgl ns
+#endif